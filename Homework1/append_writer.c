@@ -0,0 +1,341 @@
+#include "append_writer.h"
+#include "grade_index.h"
+#include "record_lock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+int append_open(append_writer_t *aw, const char *filename, const char *indexed, sync_policy_t sync, size_t group_records)
+{
+    // Grades files are written at reserved offsets, which O_APPEND would ignore
+    aw->fd = open(filename, O_WRONLY | O_CREAT | (indexed == NULL ? O_APPEND : 0), 0666);
+    if (aw->fd == -1)
+    {
+        return -1;
+    }
+    aw->indexed = indexed;
+    aw->sync = sync;
+    aw->group_records = sync == SYNC_EVERY ? 1 : group_records;
+    aw->len = 0;
+    aw->count = 0;
+    aw->commits = 0;
+    aw->syncs = 0;
+    return 0;
+}
+
+// Turn record starts relative to a write at base into file offsets and add them to the
+// indexes. The indexes are not synced: a stale index is detected and rebuilt from the file.
+static int update_indexes(append_writer_t *aw, uint64_t *starts, size_t count, off_t base, size_t len)
+{
+    if (aw->indexed == NULL || count == 0 || base < 0)
+    {
+        return 0;
+    }
+    uint64_t new_size = (uint64_t)base + len;
+    for (size_t i = 0; i < count; i++)
+    {
+        starts[i] += (uint64_t)base;
+    }
+    if (name_index_append(aw->indexed, starts, count, new_size) == -1 ||
+        line_index_append(aw->indexed, starts, count, new_size) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int sync_data(append_writer_t *aw)
+{
+    if (aw->sync == SYNC_NONE)
+    {
+        return 0;
+    }
+    if (fdatasync(aw->fd) == -1)
+    {
+        return -1;
+    }
+    aw->syncs++;
+    return 0;
+}
+
+// Reserve len bytes at the end of the grades file, whose last byte is last: lock
+// [*start, *start + len) under the reservation lock, then grow the file over it by writing
+// that byte, so readers stop short of the range until it is unlocked. A file replaced by
+// compaction is reopened first.
+static int reserve_range(append_writer_t *aw, size_t len, char last, off_t *start)
+{
+    struct stat st;
+    for (;;)
+    {
+        if (record_lock(aw->fd, F_WRLCK, RECORD_RESERVE_BYTE, 1) == -1)
+        {
+            return -1;
+        }
+        if (fstat(aw->fd, &st) == -1)
+        {
+            break;
+        }
+        if (st.st_nlink > 0)
+        {
+            *start = st.st_size;
+            if (record_lock(aw->fd, F_WRLCK, *start, (off_t)len) == -1)
+            {
+                break;
+            }
+            if (pwrite(aw->fd, &last, 1, *start + (off_t)len - 1) != 1)
+            {
+                record_lock(aw->fd, F_UNLCK, *start, (off_t)len);
+                break;
+            }
+            aw->commits++;
+            return record_lock(aw->fd, F_UNLCK, RECORD_RESERVE_BYTE, 1);
+        }
+        int fd = open(aw->indexed, O_WRONLY | O_CREAT, 0666);
+        if (fd == -1)
+        {
+            break;
+        }
+        close(aw->fd); // also drops the reservation lock
+        aw->fd = fd;
+    }
+    int saved = errno;
+    record_lock(aw->fd, F_UNLCK, RECORD_RESERVE_BYTE, 1);
+    errno = saved;
+    return -1;
+}
+
+// Write left bytes held in parts, continuing after short writes. A negative offset appends,
+// and *base is set to where the first byte landed.
+static int write_parts(append_writer_t *aw, struct iovec *parts, int part_count, size_t left, off_t offset, off_t *base)
+{
+    while (left > 0)
+    {
+        ssize_t written = offset < 0 ? writev(aw->fd, parts, part_count) : pwritev(aw->fd, parts, part_count, offset);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        aw->commits++;
+        if (*base == -1)
+        {
+            *base = offset < 0 ? lseek(aw->fd, 0, SEEK_CUR) - written : offset;
+        }
+        if (offset >= 0)
+        {
+            offset += written;
+        }
+        left -= (size_t)written;
+
+        // Skip what a short write already sent
+        while (part_count > 0 && (size_t)written >= parts->iov_len)
+        {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            part_count--;
+        }
+        if (part_count > 0)
+        {
+            parts->iov_base = (char *)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+// Remove the last byte from parts and return it
+static char take_last_byte(struct iovec *parts, int *part_count)
+{
+    while (parts[*part_count - 1].iov_len == 0)
+    {
+        (*part_count)--;
+    }
+    struct iovec *last = &parts[*part_count - 1];
+    last->iov_len--;
+    return ((const char *)last->iov_base)[last->iov_len];
+}
+
+// Send total bytes held in parts and sync them by the policy. Plain files take one O_APPEND
+// writev(), which lands contiguously at the end even when other processes append too.
+// Grades files are shared by concurrent writers and readers, so the data goes to a reserved
+// range instead, whose final newline is written first when reserving it. A writer that dies
+// mid-record leaves a line of its own that still ends in a NUL byte of the grown file, and
+// readers skip it: the byte before the newline is the record-complete marker. With a sync
+// policy the marker waits until the rest of the range is on disk.
+static int send_parts(append_writer_t *aw, struct iovec *parts, int part_count, size_t total, off_t *base)
+{
+    *base = -1;
+    if (aw->indexed == NULL)
+    {
+        return write_parts(aw, parts, part_count, total, -1, base) == -1 ? -1 : sync_data(aw);
+    }
+
+    off_t start;
+    char newline = take_last_byte(parts, &part_count);
+    if (reserve_range(aw, total, newline, &start) == -1)
+    {
+        return -1;
+    }
+    *base = start;
+
+    size_t body = total - 1;
+    int split = aw->sync != SYNC_NONE && body > 0;
+    char marker = 0;
+    if (split)
+    {
+        marker = take_last_byte(parts, &part_count);
+        body--;
+    }
+    int result = write_parts(aw, parts, part_count, body, start, base);
+    if (result == 0 && split)
+    {
+        result = sync_data(aw);
+        if (result == 0)
+        {
+            result = write_parts(aw, &(struct iovec){ &marker, 1 }, 1, 1, start + (off_t)body, base);
+        }
+    }
+    if (result == 0)
+    {
+        result = sync_data(aw);
+    }
+    if (record_lock(aw->fd, F_UNLCK, start, (off_t)total) == -1)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+int append_commit(append_writer_t *aw)
+{
+    if (aw->len == 0)
+    {
+        return 0;
+    }
+
+    struct iovec part = { aw->data, aw->len };
+    off_t base;
+    if (send_parts(aw, &part, 1, aw->len, &base) == -1)
+    {
+        return -1;
+    }
+
+    int result = update_indexes(aw, aw->starts, aw->count, base, aw->len);
+    aw->len = 0;
+    aw->count = 0;
+    return result;
+}
+
+// Buffer raw bytes, such as log messages
+int append_write(append_writer_t *aw, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (aw->len == APPEND_BUFFER_SIZE && append_commit(aw) == -1)
+        {
+            return -1;
+        }
+        size_t chunk = APPEND_BUFFER_SIZE - aw->len;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(aw->data + aw->len, data, chunk);
+        aw->len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// Buffer one "name grade" line. A record never straddles two commits.
+int append_record(append_writer_t *aw, const char *name, size_t name_len, const char *grade, size_t grade_len)
+{
+    size_t len = name_len + 1 + grade_len + 1;
+    if (len > APPEND_BUFFER_SIZE)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if ((aw->len + len > APPEND_BUFFER_SIZE || aw->count == APPEND_MAX_RECORDS) && append_commit(aw) == -1)
+    {
+        return -1;
+    }
+
+    char *out = aw->data + aw->len;
+    memcpy(out, name, name_len);
+    out[name_len] = ' ';
+    memcpy(out + name_len + 1, grade, grade_len);
+    out[len - 1] = '\n';
+    aw->starts[aw->count++] = aw->len;
+    aw->len += len;
+
+    if (aw->group_records > 0 && aw->count >= aw->group_records)
+    {
+        return append_commit(aw);
+    }
+    return 0;
+}
+
+// Append prepared records, held in parts, with one writev() after committing anything
+// buffered. starts holds the count record starts relative to the first part and comes
+// back as file offsets. Large imports use this instead of copying through the buffer.
+int append_batch(append_writer_t *aw, struct iovec *parts, int part_count, uint64_t *starts, size_t count)
+{
+    size_t total = 0;
+    off_t base = -1;
+
+    if (append_commit(aw) == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < part_count; i++)
+    {
+        total += parts[i].iov_len;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    if (send_parts(aw, parts, part_count, total, &base) == -1)
+    {
+        return -1;
+    }
+    return update_indexes(aw, starts, count, base, total);
+}
+
+int append_close(append_writer_t *aw)
+{
+    int result = append_commit(aw);
+    if (close(aw->fd) == -1)
+    {
+        result = -1;
+    }
+    aw->fd = -1;
+    return result;
+}
+
+int parse_sync_policy(const char *text, sync_policy_t *sync)
+{
+    if (strcmp(text, "none") == 0)
+    {
+        *sync = SYNC_NONE;
+    } else if (strcmp(text, "group") == 0)
+    {
+        *sync = SYNC_GROUP;
+    } else if (strcmp(text, "every") == 0)
+    {
+        *sync = SYNC_EVERY;
+    } else
+    {
+        return -1;
+    }
+    return 0;
+}
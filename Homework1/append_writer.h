@@ -0,0 +1,44 @@
+#ifndef APPEND_WRITER_H
+#define APPEND_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define APPEND_BUFFER_SIZE (64 * 1024)
+#define APPEND_MAX_RECORDS 4096  // records tracked per commit for the index updates
+#define APPEND_GROUP_RECORDS 1024 // default records per group commit
+
+// When appended data is forced to disk
+typedef enum {
+    SYNC_NONE,  // leave it to the kernel, as plain write() does
+    SYNC_GROUP, // one fdatasync per commit
+    SYNC_EVERY  // commit and fdatasync after every record
+} sync_policy_t;
+
+// Buffered appender. A commit sends everything buffered at once, then records the new lines
+// in the name and line indexes of the file with one update each. Plain files are opened with
+// O_APPEND; grades files take the locked range protocol of record_lock.h, so any number of
+// processes can append while readers see only finished records.
+typedef struct {
+    int fd;
+    const char *indexed;     // grades file whose indexes follow the appends, NULL for plain files
+    sync_policy_t sync;
+    size_t group_records;    // commit once this many records are buffered, 0 to wait for a full buffer
+    char data[APPEND_BUFFER_SIZE];
+    size_t len;
+    uint64_t starts[APPEND_MAX_RECORDS]; // record starts within data, later file offsets
+    size_t count;
+    unsigned long commits;   // writes issued
+    unsigned long syncs;
+} append_writer_t;
+
+int append_open(append_writer_t *aw, const char *filename, const char *indexed, sync_policy_t sync, size_t group_records);
+int append_write(append_writer_t *aw, const char *data, size_t len);
+int append_record(append_writer_t *aw, const char *name, size_t name_len, const char *grade, size_t grade_len);
+int append_commit(append_writer_t *aw);
+int append_batch(append_writer_t *aw, struct iovec *parts, int part_count, uint64_t *starts, size_t count);
+int append_close(append_writer_t *aw);
+int parse_sync_policy(const char *text, sync_policy_t *sync);
+
+#endif
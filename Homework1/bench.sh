@@ -0,0 +1,62 @@
+#!/bin/sh
+# Time every read command on generated grades files and append the results to a CSV.
+# Usage: ./bench.sh [rows...]   (make bench BENCH_SIZES="1000 100000")
+# BENCH_CSV and BENCH_DIR choose the results file and where the generated data is kept.
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SIZES=${*:-"1000 10000 100000 1000000 10000000"}
+CSV=${BENCH_CSV:-$HERE/bench_results.csv}
+DATA=${BENCH_DIR:-$HERE/bench_data}
+COMMIT=$(git -C "$HERE" rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+
+case "$CSV" in /*) ;; *) CSV=$(pwd)/$CSV ;; esac
+case "$DATA" in /*) ;; *) DATA=$(pwd)/$DATA ;; esac
+if [ ! -f "$CSV" ]; then
+    echo "date,commit,rows,command,wall_ms,user_ms,sys_ms,max_rss_kb,read_syscalls,write_syscalls,read_bytes,write_bytes,status" > "$CSV"
+fi
+
+# The command script and the output are scratch files next to the data, so the output
+# lands on the same file system as before; they go away however the script ends
+mkdir -p "$DATA"
+COMMANDS=$(mktemp "$DATA/bench_commands.XXXXXX")
+OUTPUT=$(mktemp "$DATA/bench_output.XXXXXX")
+trap 'rm -f "$COMMANDS" "$OUTPUT"' EXIT
+trap 'exit 1' HUP INT TERM
+
+# Run one command in batch mode in the current directory and record it. Output goes to a
+# real file: /dev/null would make showAll and sortAll look free.
+run() {
+    label=$1
+    shift
+    printf '%s\n' "$*" > "$COMMANDS"
+    result=$("$HERE/bench_run" "$OUTPUT" "$HERE/gtuStudentGrades" -b "$COMMANDS")
+    echo "$DATE,$COMMIT,$rows,$label,$result" >> "$CSV"
+    echo "$result" | awk -F, -v rows="$rows" -v label="$label" \
+        '{ printf "%10s  %-20s %10.1f ms %8d KB RSS %8d syscalls\n", rows, label, $1, $4, $5 + $6 }'
+}
+
+for rows in $SIZES; do
+    dir=$DATA/$rows
+    mkdir -p "$dir"
+    if [ ! -s "$dir/grades.txt" ]; then
+        echo "Generating $rows rows..."
+        "$HERE/gen_grades" "$rows" > "$dir/grades.txt"
+    fi
+    cd "$dir"
+
+    # A two-word name from the middle of the file, and the page holding it
+    name=$(awk -v target=$((rows / 2)) 'NR >= target && NF == 3 { print $1, $2; exit }' grades.txt)
+    page=$((rows / 20 + 1))
+
+    rm -f grades.txt.idx grades.txt.lines
+    run "searchStudent cold" searchStudent "$name"
+    run "searchStudent" searchStudent "$name"
+    run "listSome" listSome 10 "$page" grades.txt
+    run "showAll" showAll grades.txt
+    run "sortAll name" sortAll grades.txt -k name -o asc
+    run "sortAll grade" sortAll grades.txt -k grade -o asc
+    run "stats" stats grades.txt
+done
+echo "Results appended to $CSV"
@@ -0,0 +1,103 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+// Read and write syscalls and bytes of a process, from /proc/<pid>/io
+typedef struct {
+    unsigned long long syscr;
+    unsigned long long syscw;
+    unsigned long long rchar;
+    unsigned long long wchar;
+} io_counters_t;
+
+static int read_io(pid_t pid, io_counters_t *io)
+{
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    memset(io, 0, sizeof(*io));
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        sscanf(line, "syscr: %llu", &io->syscr);
+        sscanf(line, "syscw: %llu", &io->syscw);
+        sscanf(line, "rchar: %llu", &io->rchar);
+        sscanf(line, "wchar: %llu", &io->wchar);
+    }
+    fclose(file);
+    return 0;
+}
+
+static double ms(const struct timeval *tv)
+{
+    return (double)tv->tv_sec * 1000.0 + (double)tv->tv_usec / 1000.0;
+}
+
+// Run a command with its stdout sent to output and print one CSV row of what it cost:
+// wall_ms,user_ms,sys_ms,max_rss_kb,read_syscalls,write_syscalls,read_bytes,write_bytes,status
+int main(int argc, char *argv[])
+{
+    struct timespec start, end;
+    struct rusage usage;
+    io_counters_t io;
+    siginfo_t info;
+    int status;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: bench_run output command [args...]\n");
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0)
+    {
+        int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1)
+        {
+            perror(argv[1]);
+            _exit(127);
+        }
+        close(fd);
+        execv(argv[2], &argv[2]);
+        perror(argv[2]);
+        _exit(127);
+    }
+
+    // Wait without reaping: the counters in /proc vanish with the zombie
+    if (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) == -1)
+    {
+        perror("waitid");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (read_io(pid, &io) == -1)
+    {
+        memset(&io, 0, sizeof(io));
+    }
+    if (wait4(pid, &status, 0, &usage) == -1)
+    {
+        perror("wait4");
+        return EXIT_FAILURE;
+    }
+
+    double wall = (double)(end.tv_sec - start.tv_sec) * 1000.0 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("%.3f,%.3f,%.3f,%ld,%llu,%llu,%llu,%llu,%d\n", wall, ms(&usage.ru_utime), ms(&usage.ru_stime),
+           usage.ru_maxrss, io.syscr, io.syscw, io.rchar, io.wchar, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return EXIT_SUCCESS;
+}
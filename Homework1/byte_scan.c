@@ -0,0 +1,351 @@
+#include "byte_scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#define SCAN_NTH_BLOCK 1024 // bytes counted at once while looking for the n-th match
+
+#define LOW_BITS 0x7f7f7f7f7f7f7f7fULL
+
+// High bit set in every byte of word that equals the byte repeated in pattern, with no
+// false positives (the usual (v - 0x01..) & ~v trick can flag a 0x01 above a match)
+static uint64_t match_bits(uint64_t word, uint64_t pattern)
+{
+    uint64_t v = word ^ pattern;
+    uint64_t t = (v & LOW_BITS) + LOW_BITS;
+    return ~(t | v | LOW_BITS);
+}
+
+static uint64_t load_word(const char *p)
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Word-at-a-time kernels, for CPUs without SSE2 and for the tails of the vector loops
+
+static const char *find_scalar(const char *data, size_t len, char c)
+{
+    uint64_t pattern = 0x0101010101010101ULL * (unsigned char)c;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        if (match_bits(load_word(data + i), pattern) != 0)
+        {
+            break;
+        }
+    }
+    for (; i < len; i++)
+    {
+        if (data[i] == c)
+        {
+            return data + i;
+        }
+    }
+    return NULL;
+}
+
+static const char *find_last_scalar(const char *data, size_t len, char c)
+{
+    uint64_t pattern = 0x0101010101010101ULL * (unsigned char)c;
+    size_t i = len;
+    for (; i >= 8; i -= 8)
+    {
+        if (match_bits(load_word(data + i - 8), pattern) != 0)
+        {
+            break;
+        }
+    }
+    while (i > 0)
+    {
+        i--;
+        if (data[i] == c)
+        {
+            return data + i;
+        }
+    }
+    return NULL;
+}
+
+static size_t count_scalar(const char *data, size_t len, char c)
+{
+    uint64_t pattern = 0x0101010101010101ULL * (unsigned char)c;
+    size_t total = 0, i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        total += (size_t)__builtin_popcountll(match_bits(load_word(data + i), pattern));
+    }
+    for (; i < len; i++)
+    {
+        total += data[i] == c;
+    }
+    return total;
+}
+
+#ifdef SCAN_X86
+
+// SSE2 kernels, 16 bytes per compare
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *data, size_t len, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), needle);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 16)), needle);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 32)), needle);
+        __m128i e = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(d, e))) != 0)
+        {
+            break; // the 16-byte loop below finds the exact position
+        }
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), needle));
+        if (mask != 0)
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(data + i, len - i, c);
+}
+
+__attribute__((target("sse2")))
+static const char *find_last_sse2(const char *data, size_t len, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = len;
+    for (; i >= 16; i -= 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i - 16)), needle));
+        if (mask != 0)
+        {
+            return data + i - 16 + (31 - __builtin_clz(mask));
+        }
+    }
+    return find_last_scalar(data, i, c);
+}
+
+__attribute__((target("sse2")))
+static size_t count_sse2(const char *data, size_t len, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    size_t total = 0, i = 0;
+    while (i + 16 <= len)
+    {
+        // Byte counters overflow after 255 matches, so fold them into 64-bit sums in time
+        size_t block_end = len - (len - i) % 16;
+        if (block_end - i > 255 * 16)
+        {
+            block_end = i + 255 * 16;
+        }
+        __m128i counts = zero;
+        for (; i < block_end; i += 16)
+        {
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), needle));
+        }
+        __m128i sums = _mm_sad_epu8(counts, zero);
+        total += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return total + count_scalar(data + i, len - i, c);
+}
+
+// AVX2 kernels, 32 bytes per compare. Compiled for AVX2 here only and called only when
+// the CPU reports it, so the rest of the program keeps the default instruction set.
+// They never call the SSE2 kernels: mixing legacy SSE and AVX code stalls on every switch.
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *data, size_t len, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), needle);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 32)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0)
+        {
+            unsigned mask = (unsigned)_mm256_movemask_epi8(a);
+            if (mask != 0)
+            {
+                return data + i + __builtin_ctz(mask);
+            }
+            return data + i + 32 + __builtin_ctz((unsigned)_mm256_movemask_epi8(b));
+        }
+    }
+    for (; i + 32 <= len; i += 32)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), needle));
+        if (mask != 0)
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+    // The 16-byte step stays in this function so it is VEX-encoded too
+    if (i + 16 <= len)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), _mm256_castsi256_si128(needle)));
+        if (mask != 0)
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return find_scalar(data + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char *find_last_avx2(const char *data, size_t len, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = len;
+    for (; i >= 32; i -= 32)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i - 32)), needle));
+        if (mask != 0)
+        {
+            return data + i - 32 + (31 - __builtin_clz(mask));
+        }
+    }
+    if (i >= 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i - 16)), _mm256_castsi256_si128(needle)));
+        if (mask != 0)
+        {
+            return data + i - 16 + (31 - __builtin_clz(mask));
+        }
+        i -= 16;
+    }
+    return find_last_scalar(data, i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const char *data, size_t len, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t total = 0, i = 0;
+    while (i + 32 <= len)
+    {
+        size_t block_end = len - (len - i) % 32;
+        if (block_end - i > 255 * 32)
+        {
+            block_end = i + 255 * 32;
+        }
+        __m256i counts = zero;
+        for (; i < block_end; i += 32)
+        {
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), needle));
+        }
+        __m256i sums = _mm256_sad_epu8(counts, zero);
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, sums);
+        total += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+    return total + count_scalar(data + i, len - i, c);
+}
+
+#endif
+
+// Fastest first
+static const scan_kernels_t kernels[] = {
+#ifdef SCAN_X86
+    { "avx2", find_avx2, find_last_avx2, count_avx2 },
+    { "sse2", find_sse2, find_last_sse2, count_sse2 },
+#endif
+    { "scalar", find_scalar, find_last_scalar, count_scalar },
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+// Index of the fastest kernels the CPU supports. Racing first calls all store the same value.
+static size_t best_kernels(void)
+{
+    static int chosen = -1;
+    if (chosen == -1)
+    {
+        int best = (int)KERNEL_COUNT - 1;
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            best = 0;
+        } else if (__builtin_cpu_supports("sse2"))
+        {
+            best = 1;
+        }
+#endif
+        chosen = best;
+    }
+    return (size_t)chosen;
+}
+
+const scan_kernels_t *scan_active(void)
+{
+    return &kernels[best_kernels()];
+}
+
+// Every implementation this CPU can run, fastest first
+const scan_kernels_t *scan_available(size_t *count)
+{
+    size_t best = best_kernels();
+    *count = KERNEL_COUNT - best;
+    return &kernels[best];
+}
+
+const char *scan_find(const char *data, size_t len, char c)
+{
+    return kernels[best_kernels()].find(data, len, c);
+}
+
+const char *scan_find_last(const char *data, size_t len, char c)
+{
+    return kernels[best_kernels()].find_last(data, len, c);
+}
+
+size_t scan_count(const char *data, size_t len, char c)
+{
+    return kernels[best_kernels()].count(data, len, c);
+}
+
+// The n-th c (counting from 1), or NULL when there are fewer. Whole blocks are counted
+// rather than searched, so long skips cost one vector compare per 32 bytes.
+const char *scan_nth(const char *data, size_t len, char c, size_t n)
+{
+    const scan_kernels_t *k = &kernels[best_kernels()];
+    size_t pos = 0;
+
+    if (n == 0)
+    {
+        return NULL;
+    }
+    while (n > SCAN_NTH_BLOCK / 64 && len - pos > SCAN_NTH_BLOCK)
+    {
+        size_t found = k->count(data + pos, SCAN_NTH_BLOCK, c);
+        if (found >= n)
+        {
+            break;
+        }
+        n -= found;
+        pos += SCAN_NTH_BLOCK;
+    }
+    while (pos < len)
+    {
+        const char *match = k->find(data + pos, len - pos, c);
+        if (match == NULL || --n == 0)
+        {
+            return match;
+        }
+        pos = (size_t)(match - data) + 1;
+    }
+    return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef BYTE_SCAN_H
+#define BYTE_SCAN_H
+
+#include <stddef.h>
+
+// One implementation of the byte scanning kernels
+typedef struct {
+    const char *name;
+    const char *(*find)(const char *data, size_t len, char c);      // first c, or NULL
+    const char *(*find_last)(const char *data, size_t len, char c); // last c, or NULL
+    size_t (*count)(const char *data, size_t len, char c);
+} scan_kernels_t;
+
+// Kernels used by the parsers: AVX2 or SSE2 when the CPU has them, word-at-a-time C otherwise
+const char *scan_find(const char *data, size_t len, char c);
+const char *scan_find_last(const char *data, size_t len, char c);
+size_t scan_count(const char *data, size_t len, char c);
+const char *scan_nth(const char *data, size_t len, char c, size_t n);
+
+const scan_kernels_t *scan_active(void);
+const scan_kernels_t *scan_available(size_t *count);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stddef.h>
+
+#define DEFAULT_SORT_MEMORY_MB 64 // memory sortAll may use for records before spilling runs to disk
+#define MAX_SORT_THREADS 64
+
+typedef struct {
+    char name[100];
+    char grade[3];
+} StudentGrade;
+
+typedef enum {
+    BY_NAME,
+    BY_GRADE
+} SortBy;
+
+typedef enum {
+    ASCENDING,
+    DESCENDING
+} SortOrder;
+
+typedef struct {
+    SortBy sortBy;
+    SortOrder sortOrder;
+    size_t memoryBudget; // bytes
+    int threads;         // workers for the in-memory sort
+    int report;          // print timings against the single-threaded StudentGrade sort
+    int nameOrder;       // break grade ties by name instead of file order
+} SortOptions;
+
+#endif
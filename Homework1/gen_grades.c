@@ -0,0 +1,137 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_DEFAULT_SEED 344
+#define GEN_SECOND_NAME_PERCENT 8 // students with two given names, such as "Ayse Nur"
+#define GEN_NAME_SKEW 1.0         // Zipf exponent: a few names are very common, most are rare
+
+static const char *first_names[] = {
+    "Mehmet", "Mustafa", "Ahmet", "Ali", "Huseyin", "Hasan", "Ibrahim", "Ismail", "Osman", "Yusuf",
+    "Murat", "Omer", "Ramazan", "Halil", "Suleyman", "Abdullah", "Mahmut", "Recep", "Salih", "Fatih",
+    "Kadir", "Emre", "Hakan", "Adem", "Kemal", "Yasar", "Bekir", "Musa", "Metin", "Serkan",
+    "Fatma", "Ayse", "Emine", "Hatice", "Zeynep", "Elif", "Meryem", "Sultan", "Sevgi", "Hulya",
+    "Zehra", "Leyla", "Merve", "Esra", "Busra", "Ozlem", "Derya", "Gulsen", "Yasemin", "Kubra",
+    "Aysegul", "Nur", "Ece", "Defne", "Asya", "Eylul", "Selin", "Irem", "Ceren", "Buse",
+    "Can", "Cem", "Deniz", "Eren", "Efe", "Kaan", "Berk", "Arda", "Baris", "Burak",
+    "Onur", "Tolga", "Ugur", "Volkan", "Sinan", "Selim", "Tuna", "Alp", "Umut", "Oguz",
+};
+
+static const char *surnames[] = {
+    "Yilmaz", "Kaya", "Demir", "Sahin", "Celik", "Yildiz", "Yildirim", "Ozturk", "Aydin", "Ozdemir",
+    "Arslan", "Dogan", "Kilic", "Aslan", "Cetin", "Kara", "Koc", "Kurt", "Ozkan", "Simsek",
+    "Polat", "Ozcan", "Korkmaz", "Cakir", "Erdogan", "Yavuz", "Can", "Acar", "Sen", "Aktas",
+    "Guler", "Yalcin", "Gunes", "Bozkurt", "Bulut", "Keskin", "Unal", "Turan", "Gul", "Ozer",
+    "Isik", "Kaplan", "Avci", "Sari", "Tekin", "Tas", "Kose", "Yuksel", "Ates", "Aksoy",
+    "Demirci", "Karaca", "Coskun", "Ekinci", "Bayram", "Erdem", "Toprak", "Kocak", "Altun", "Uslu",
+    "Durmaz", "Akgul", "Tunc", "Soylu", "Karatas", "Gok", "Sonmez", "Bicer", "Kalkan", "Duman",
+    "Oztek", "Eren", "Ergin", "Akin", "Bozdag", "Tasdemir", "Ucar", "Cinar", "Savas", "Gurbuz",
+};
+
+// A typical class: most students pass with a middle grade
+static const struct {
+    const char *grade;
+    unsigned weight;
+} grade_weights[] = {
+    { "AA", 9 }, { "BA", 11 }, { "BB", 15 }, { "CB", 16 },
+    { "CC", 16 }, { "DC", 11 }, { "DD", 8 }, { "FF", 14 },
+};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+// xorshift64*
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+// Cumulative weights, so a draw is a binary search
+static void zipf_table(double *cumulative, size_t count, double skew)
+{
+    double total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total += 1.0 / pow((double)(i + 1), skew);
+        cumulative[i] = total;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        cumulative[i] /= total;
+    }
+}
+
+static size_t draw(const double *cumulative, size_t count, uint64_t *state)
+{
+    double u = (double)(next_random(state) >> 11) / 9007199254740992.0;
+    size_t low = 0, high = count - 1;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (cumulative[mid] < u)
+        {
+            low = mid + 1;
+        } else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Write rows "Name Surname GRADE" lines to stdout. Names follow a Zipf distribution over
+// common Turkish given names and surnames, so a few spellings dominate the way they do in
+// real class lists; a student number keeps nearly every full name unique.
+int main(int argc, char *argv[])
+{
+    double first_cdf[COUNT(first_names)], surname_cdf[COUNT(surnames)];
+    unsigned grade_total = 0;
+    static char buffer[1 << 20];
+
+    if (argc < 2 || atoll(argv[1]) <= 0)
+    {
+        fprintf(stderr, "Usage: gen_grades rows [seed] > grades.txt\n");
+        return EXIT_FAILURE;
+    }
+    unsigned long long rows = (unsigned long long)atoll(argv[1]);
+    uint64_t state = argc > 2 ? (uint64_t)atoll(argv[2]) : GEN_DEFAULT_SEED;
+    state = state * 0x9e3779b97f4a7c15ULL + 1; // never zero
+
+    zipf_table(first_cdf, COUNT(first_names), GEN_NAME_SKEW);
+    zipf_table(surname_cdf, COUNT(surnames), GEN_NAME_SKEW);
+    for (size_t i = 0; i < COUNT(grade_weights); i++)
+    {
+        grade_total += grade_weights[i].weight;
+    }
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    // Numbers are drawn from four times as many as there are rows, so names rarely repeat
+    unsigned long long numbers = rows * 4;
+    for (unsigned long long i = 0; i < rows; i++)
+    {
+        const char *first = first_names[draw(first_cdf, COUNT(first_names), &state)];
+        const char *surname = surnames[draw(surname_cdf, COUNT(surnames), &state)];
+        unsigned long long number = next_random(&state) % numbers;
+
+        unsigned pick = (unsigned)(next_random(&state) % grade_total);
+        size_t g = 0;
+        while (pick >= grade_weights[g].weight)
+        {
+            pick -= grade_weights[g++].weight;
+        }
+
+        if (next_random(&state) % 100 < GEN_SECOND_NAME_PERCENT)
+        {
+            const char *second = first_names[draw(first_cdf, COUNT(first_names), &state)];
+            printf("%s %s %s%llu %s\n", first, second, surname, number, grade_weights[g].grade);
+        } else
+        {
+            printf("%s %s%llu %s\n", first, surname, number, grade_weights[g].grade);
+        }
+    }
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,254 @@
+#include "grade_compact.h"
+#include "byte_scan.h"
+#include "grade_index.h"
+#include "out_buffer.h"
+#include "record_lock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Open addressing slot: hash of the name and 1 + offset of its latest record, 0 when empty
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;
+} name_slot_t;
+
+// Old and new offset of a kept record
+typedef struct {
+    uint64_t from;
+    uint64_t to;
+} moved_record_t;
+
+// qsort has no context argument, so the file being compacted is kept here while sorting
+static const grade_file_t *compact_file = NULL;
+
+// FNV-1a
+static uint64_t hash_name(const char *name, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int same_name(const grade_file_t *gf, uint64_t offset, const char *name, size_t len)
+{
+    grade_record_t rec;
+    return grade_file_record_at(gf, (size_t)offset, &rec) == 0 && rec.name_len == len && memcmp(rec.name, name, len) == 0;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_moved_names(const void *a, const void *b)
+{
+    grade_record_t ra, rb;
+    grade_file_record_at(compact_file, (size_t)((const moved_record_t *)a)->from, &ra);
+    grade_file_record_at(compact_file, (size_t)((const moved_record_t *)b)->from, &rb);
+    return compare_names(ra.name, ra.name_len, rb.name, rb.name_len);
+}
+
+// Offsets of the latest record of every name, in file order. One hash table probe per record.
+static uint64_t *latest_records(const grade_file_t *gf, uint64_t *records, uint64_t *count)
+{
+    size_t capacity = 16;
+    size_t lines = scan_count(gf->data, gf->size, '\n') + 1;
+    while (capacity < 2 * lines)
+    {
+        capacity *= 2; // at most half full, so probe runs stay short
+    }
+    name_slot_t *table = calloc(capacity, sizeof(name_slot_t));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    grade_record_t rec;
+    size_t cursor = 0;
+    uint64_t used = 0;
+    *records = 0;
+    while (grade_file_next(gf, &cursor, &rec))
+    {
+        uint64_t hash = hash_name(rec.name, rec.name_len);
+        uint64_t offset = (uint64_t)(rec.line - gf->data);
+        size_t i = (size_t)hash & (capacity - 1);
+        while (table[i].offset != 0 &&
+               (table[i].hash != hash || !same_name(gf, table[i].offset - 1, rec.name, rec.name_len)))
+        {
+            i = (i + 1) & (capacity - 1);
+        }
+        used += table[i].offset == 0;
+        table[i].hash = hash;
+        table[i].offset = offset + 1; // a later record of the same name replaces the earlier one
+        (*records)++;
+    }
+
+    uint64_t *latest = malloc((used > 0 ? used : 1) * sizeof(uint64_t));
+    if (latest != NULL)
+    {
+        uint64_t n = 0;
+        for (size_t i = 0; i < capacity; i++)
+        {
+            if (table[i].offset != 0)
+            {
+                latest[n++] = table[i].offset - 1;
+            }
+        }
+        qsort(latest, n, sizeof(uint64_t), compare_offsets);
+        *count = n;
+    }
+    free(table);
+    return latest;
+}
+
+// Write the records at offsets to fd in order, remembering where each one lands
+static int write_records(const grade_file_t *gf, const uint64_t *offsets, uint64_t count, int fd, moved_record_t *moved, uint64_t *size)
+{
+    out_buffer_t *out = malloc(sizeof(out_buffer_t));
+    if (out == NULL)
+    {
+        return -1;
+    }
+    out_init(out, fd);
+
+    int result = 0;
+    uint64_t position = 0;
+    for (uint64_t i = 0; i < count && result == 0; i++)
+    {
+        grade_record_t rec;
+        grade_file_record_at(gf, (size_t)offsets[i], &rec);
+        moved[i].from = offsets[i];
+        moved[i].to = position;
+        result = out_write(out, rec.line, rec.line_len) == -1 || out_write(out, "\n", 1) == -1 ? -1 : 0;
+        position += rec.line_len + 1;
+    }
+    if (result == 0)
+    {
+        result = out_flush(out);
+    }
+    // The new file must be on disk before it replaces the old one
+    if (result == 0)
+    {
+        result = fsync(fd);
+    }
+    free(out);
+    *size = position;
+    return result;
+}
+
+// Rewrite filename, mapped in gf, keeping only the latest record of every student, and
+// rebuild its name and line indexes from the same pass. The new file replaces the old
+// one with a rename, so readers see either the old or the compacted contents. Records
+// appended while compacting would be lost, so the rename is abandoned with EAGAIN if
+// the file grew in the meantime. Holding the reservation lock from that check until the
+// rename keeps appenders out; they find the old file unlinked and reopen the new one.
+int grade_compact(const grade_file_t *gf, const char *filename, compact_report_t *report)
+{
+    char tmp_path[512], path[512];
+    struct stat st;
+    uint64_t count = 0;
+
+    memset(report, 0, sizeof(*report));
+    report->old_size = gf->size;
+    if (gf->data == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t *latest = latest_records(gf, &report->records, &count);
+    if (latest == NULL)
+    {
+        return -1;
+    }
+    report->students = count;
+    report->new_size = gf->size;
+    if (count == report->records)
+    {
+        free(latest);
+        return 0;
+    }
+
+    moved_record_t *moved = malloc((count > 0 ? count : 1) * sizeof(moved_record_t));
+    if (moved == NULL)
+    {
+        free(latest);
+        return -1;
+    }
+    // A file of its own, so compactions racing on filename never write into one another's.
+    // It stays open: after the rename it is the new grades file the indexes describe.
+    int new_fd = grade_file_create_temp(filename, tmp_path, sizeof(tmp_path));
+    int result = new_fd == -1 ? -1 : write_records(gf, latest, count, new_fd, moved, &report->new_size);
+    int lock_fd = result == 0 ? open(filename, O_WRONLY) : -1;
+    if (result == 0 && (lock_fd == -1 || record_lock(lock_fd, F_WRLCK, RECORD_RESERVE_BYTE, 1) == -1))
+    {
+        result = -1;
+    } else if (result == 0 && fstat(lock_fd, &st) == -1)
+    {
+        result = -1;
+    } else if (result == 0 && (uint64_t)st.st_size != gf->size)
+    {
+        errno = EAGAIN;
+        result = -1;
+    } else if (result == 0 && fchmod(new_fd, st.st_mode & 07777) == -1)
+    {
+        result = -1; // the compacted file replaces grades.txt with grades.txt's permissions
+    }
+
+    // The old indexes go first: they must never be read against the new file
+    if (result == 0)
+    {
+        index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+        unlink(path);
+        index_path(path, sizeof(path), filename, LINE_INDEX_SUFFIX);
+        unlink(path);
+        result = rename(tmp_path, filename);
+    }
+    if (lock_fd != -1)
+    {
+        close(lock_fd);
+    }
+    if (result == -1)
+    {
+        if (new_fd != -1)
+        {
+            close(new_fd);
+            unlink(tmp_path);
+        }
+        free(moved);
+        free(latest);
+        return -1;
+    }
+    report->rewritten = 1;
+
+    // Records are in file order now, so their new offsets are the line index as they are,
+    // and sorting them by name gives the name index
+    for (uint64_t i = 0; i < count; i++)
+    {
+        latest[i] = moved[i].to;
+    }
+    result = line_index_write(filename, new_fd, latest, count, report->new_size);
+    compact_file = gf;
+    qsort(moved, count, sizeof(moved_record_t), compare_moved_names);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        latest[i] = moved[i].to;
+    }
+    if (name_index_write(filename, new_fd, latest, count, report->new_size) == -1)
+    {
+        result = -1;
+    }
+    close(new_fd);
+
+    free(moved);
+    free(latest);
+    return result;
+}
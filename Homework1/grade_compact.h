@@ -0,0 +1,17 @@
+#ifndef GRADE_COMPACT_H
+#define GRADE_COMPACT_H
+
+#include <stdint.h>
+#include "grade_file.h"
+
+typedef struct {
+    uint64_t records;  // records read
+    uint64_t students; // distinct names, one record each after compaction
+    uint64_t old_size;
+    uint64_t new_size;
+    int rewritten;     // 0 when every name already had a single record
+} compact_report_t;
+
+int grade_compact(const grade_file_t *gf, const char *filename, compact_report_t *report);
+
+#endif
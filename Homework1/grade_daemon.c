@@ -0,0 +1,486 @@
+#include "grade_daemon.h"
+#include "grade_file.h"
+#include "grade_index.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// Grades file, name index and line index kept mapped between requests. Workers forked
+// for a request inherit the mappings, so commands skip open, mmap and index validation.
+typedef struct {
+    const char *filename;
+    struct stat st;      // identity of the file when it was mapped
+    int loaded;
+    grade_file_t file;
+    name_index_t names;
+    int has_names;
+    line_index_t lines;
+    int has_lines;
+} grade_cache_t;
+
+typedef struct {
+    int fd;              // -1 for a free slot
+    pid_t worker;        // child running the current request, 0 while idle
+    char request[DAEMON_REQUEST_MAX];
+    size_t len;
+} daemon_client_t;
+
+static int wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t stopping = 0;
+
+// Signal handlers only poke the poll loop, which does the real work
+static void on_child(int signo)
+{
+    int saved = errno;
+    write(wake_pipe[1], "c", 1);
+    errno = saved;
+}
+
+static void on_stop(int signo)
+{
+    int saved = errno;
+    stopping = 1;
+    write(wake_pipe[1], "s", 1);
+    errno = saved;
+}
+
+static void cache_drop(grade_cache_t *cache)
+{
+    grade_file_set_resident(NULL, NULL);
+    name_index_set_resident(NULL, NULL);
+    line_index_set_resident(NULL, NULL);
+    if (cache->has_lines)
+    {
+        line_index_close(&cache->lines);
+    }
+    if (cache->has_names)
+    {
+        name_index_close(&cache->names);
+    }
+    if (cache->loaded)
+    {
+        grade_file_close(&cache->file);
+    }
+    cache->loaded = 0;
+    cache->has_names = 0;
+    cache->has_lines = 0;
+}
+
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// Remap the file and reload its indexes when it was replaced, appended to or touched.
+// A missing file just leaves the cache empty; the command reports the error itself.
+static void cache_refresh(grade_cache_t *cache)
+{
+    struct stat st;
+    if (stat(cache->filename, &st) == -1)
+    {
+        cache_drop(cache);
+        return;
+    }
+    if (cache->loaded && same_file(&st, &cache->st))
+    {
+        return;
+    }
+
+    cache_drop(cache);
+    if (grade_file_open(&cache->file, cache->filename) == -1)
+    {
+        return;
+    }
+    if (fstat(cache->file.fd, &cache->st) == -1)
+    {
+        grade_file_close(&cache->file);
+        return;
+    }
+    cache->loaded = 1;
+
+    // The indexes are brought up to date here, once, instead of by every request
+    cache->has_names = name_index_open(&cache->names, cache->filename, &cache->file) == 0;
+    cache->has_lines = line_index_open(&cache->lines, cache->filename, cache->file.fd, cache->file.size) == 0;
+
+    grade_file_set_resident(cache->filename, &cache->file);
+    if (cache->has_names)
+    {
+        name_index_set_resident(cache->filename, &cache->names);
+    }
+    if (cache->has_lines)
+    {
+        line_index_set_resident(cache->filename, &cache->lines);
+    }
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write(fd, data, len);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+static void client_close(daemon_client_t *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    client->worker = 0;
+    client->len = 0;
+}
+
+// Start the next complete request of an idle client. The command runs in a forked
+// worker so that a command ending in exit() cannot take the daemon down with it.
+static void client_dispatch(daemon_client_t *client, grade_cache_t *cache, int listen_fd, command_fn execute)
+{
+    while (client->fd != -1 && client->worker == 0)
+    {
+        char *newline = memchr(client->request, '\n', client->len);
+        if (newline == NULL)
+        {
+            return;
+        }
+        *newline = '\0';
+        if (newline > client->request && newline[-1] == '\r')
+        {
+            newline[-1] = '\0';
+        }
+
+        char command[DAEMON_REQUEST_MAX];
+        strcpy(command, client->request);
+        size_t used = (size_t)(newline - client->request) + 1;
+        memmove(client->request, newline + 1, client->len - used);
+        client->len -= used;
+
+        if (strcmp(command, "exit") == 0)
+        {
+            client_close(client);
+            return;
+        }
+        if (command[0] == '\0')
+        {
+            char end = DAEMON_RESPONSE_END;
+            write_all(client->fd, &end, 1);
+            continue;
+        }
+
+        cache_refresh(cache);
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            const char message[] = "Error: daemon could not fork a worker\n";
+            write_all(client->fd, message, sizeof(message)); // sizeof counts the terminating NUL
+            continue;
+        }
+        if (pid == 0)
+        {
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            close(listen_fd);
+            close(wake_pipe[0]);
+            close(wake_pipe[1]);
+            if (dup2(client->fd, STDOUT_FILENO) == -1 || dup2(client->fd, STDERR_FILENO) == -1)
+            {
+                _exit(EXIT_FAILURE);
+            }
+            execute(command);
+            exit(EXIT_SUCCESS);
+        }
+        client->worker = pid;
+    }
+}
+
+// Collect finished workers and end their responses, even when the worker died
+static void reap_workers(daemon_client_t *clients, grade_cache_t *cache, int listen_fd, command_fn execute)
+{
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+    {
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd != -1 && clients[i].worker == pid)
+            {
+                char end = DAEMON_RESPONSE_END;
+                clients[i].worker = 0;
+                if (write_all(clients[i].fd, &end, 1) == -1)
+                {
+                    client_close(&clients[i]);
+                } else
+                {
+                    client_dispatch(&clients[i], cache, listen_fd, execute);
+                }
+                break;
+            }
+        }
+    }
+}
+
+static int listen_on(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    unlink(socket_path); // a socket left behind by a daemon that did not shut down cleanly
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serve newline-terminated commands from any number of clients until SIGINT or SIGTERM.
+// Requests of one client run in order; requests of different clients run concurrently.
+int run_daemon(const char *socket_path, const char *filename, command_fn execute)
+{
+    daemon_client_t *clients = malloc(DAEMON_MAX_CLIENTS * sizeof(daemon_client_t));
+    grade_cache_t cache = { .filename = filename };
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 2];
+    int slot_of[DAEMON_MAX_CLIENTS + 2];
+
+    if (clients == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        clients[i].fd = -1;
+        clients[i].worker = 0;
+        clients[i].len = 0;
+    }
+
+    int listen_fd = listen_on(socket_path);
+    if (listen_fd == -1 || pipe(wake_pipe) == -1)
+    {
+        free(clients);
+        return -1;
+    }
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sa.sa_handler = on_child;
+    sigaction(SIGCHLD, &sa, NULL);
+    sa.sa_flags = 0;
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // a client that hangs up must not kill the daemon
+
+    cache_refresh(&cache);
+
+    while (!stopping)
+    {
+        int count = 0;
+        fds[count].fd = wake_pipe[0];
+        fds[count++].events = POLLIN;
+        fds[count].fd = listen_fd;
+        fds[count++].events = POLLIN;
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+        {
+            // Busy clients are not read until their response is complete
+            if (clients[i].fd != -1 && clients[i].worker == 0)
+            {
+                slot_of[count] = i;
+                fds[count].fd = clients[i].fd;
+                fds[count++].events = POLLIN;
+            }
+        }
+
+        if (poll(fds, count, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            reap_workers(clients, &cache, listen_fd, execute);
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            int fd = accept(listen_fd, NULL, NULL);
+            int slot = -1;
+            for (int i = 0; fd != -1 && i < DAEMON_MAX_CLIENTS && slot == -1; i++)
+            {
+                if (clients[i].fd == -1)
+                {
+                    slot = i;
+                }
+            }
+            if (slot != -1)
+            {
+                clients[slot].fd = fd;
+                clients[slot].worker = 0;
+                clients[slot].len = 0;
+            } else if (fd != -1)
+            {
+                close(fd); // every slot is taken
+            }
+        }
+
+        for (int i = 2; i < count; i++)
+        {
+            daemon_client_t *client = &clients[slot_of[i]];
+            if (fds[i].revents == 0 || client->fd != fds[i].fd || client->worker != 0)
+            {
+                continue;
+            }
+            ssize_t got = read(client->fd, client->request + client->len, sizeof(client->request) - client->len);
+            if (got <= 0)
+            {
+                if (got == -1 && errno == EINTR)
+                {
+                    continue;
+                }
+                client_close(client);
+                continue;
+            }
+            client->len += (size_t)got;
+            if (client->len == sizeof(client->request) && memchr(client->request, '\n', client->len) == NULL)
+            {
+                const char message[] = "Error: request too long\n";
+                write_all(client->fd, message, sizeof(message));
+                client_close(client);
+                continue;
+            }
+            client_dispatch(client, &cache, listen_fd, execute);
+        }
+    }
+
+    // Let running workers finish their responses before going away
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd != -1)
+        {
+            if (clients[i].worker != 0)
+            {
+                waitpid(clients[i].worker, NULL, 0);
+            }
+            close(clients[i].fd);
+        }
+    }
+    cache_drop(&cache);
+    close(listen_fd);
+    unlink(socket_path);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    free(clients);
+    return 0;
+}
+
+int daemon_connect(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send one command and copy its response to out_fd. Returns -1 when the daemon went away.
+int daemon_request(int fd, const char *command, int out_fd)
+{
+    char buffer[64 * 1024];
+    size_t len = strlen(command);
+
+    if (len + 1 >= DAEMON_REQUEST_MAX)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memcpy(buffer, command, len);
+    buffer[len++] = '\n';
+    if (write_all(fd, buffer, len) == -1)
+    {
+        return -1;
+    }
+
+    while (1)
+    {
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            if (got == 0)
+            {
+                errno = ECONNRESET;
+            }
+            return -1;
+        }
+        char *end = memchr(buffer, DAEMON_RESPONSE_END, (size_t)got);
+        size_t keep = end != NULL ? (size_t)(end - buffer) : (size_t)got;
+        if (write_all(out_fd, buffer, keep) == -1)
+        {
+            return -1;
+        }
+        if (end != NULL)
+        {
+            return 0;
+        }
+    }
+}
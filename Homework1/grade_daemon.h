@@ -0,0 +1,15 @@
+#ifndef GRADE_DAEMON_H
+#define GRADE_DAEMON_H
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_REQUEST_MAX 1024  // longest command line a client may send
+#define DAEMON_RESPONSE_END '\0' // ends the output of every request
+
+// Runs one command with its output going to standard output
+typedef void (*command_fn)(const char *command);
+
+int run_daemon(const char *socket_path, const char *filename, command_fn execute);
+int daemon_connect(const char *socket_path);
+int daemon_request(int fd, const char *command, int out_fd);
+
+#endif
@@ -0,0 +1,188 @@
+#include "grade_file.h"
+#include "byte_scan.h"
+#include "record_lock.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Mapping kept by the daemon. grade_file_open hands out copies of it while the file is unchanged.
+static grade_file_t resident_file;
+static char resident_name[256];
+static struct stat resident_stat;
+
+void grade_file_set_resident(const char *filename, const grade_file_t *gf)
+{
+    if (filename == NULL || gf == NULL || fstat(gf->fd, &resident_stat) == -1)
+    {
+        resident_file.fd = -1;
+        return;
+    }
+    snprintf(resident_name, sizeof(resident_name), "%s", filename);
+    resident_file = *gf;
+    resident_file.resident = 1;
+}
+
+int grade_file_open(grade_file_t *gf, const char *filename)
+{
+    struct stat st;
+
+    // One fstat instead of open and mmap when the daemon already has the file mapped
+    if (resident_file.resident && resident_file.fd != -1 && strcmp(resident_name, filename) == 0 &&
+        fstat(resident_file.fd, &st) == 0 && (size_t)st.st_size == resident_file.size &&
+        st.st_mtim.tv_sec == resident_stat.st_mtim.tv_sec && st.st_mtim.tv_nsec == resident_stat.st_mtim.tv_nsec)
+    {
+        *gf = resident_file;
+        return 0;
+    }
+
+    gf->resident = 0;
+    gf->fd = open(filename, O_RDONLY);
+    if (gf->fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(gf->fd, &st) == -1)
+    {
+        close(gf->fd);
+        gf->fd = -1;
+        return -1;
+    }
+
+    // Appends still being written are left out, so every line ends where its writer ended it
+    gf->size = record_visible_size(gf->fd, (size_t)st.st_size);
+    gf->data = NULL;
+    if (gf->size == 0)
+    {
+        return 0; // mmap refuses zero-length mappings, an empty file has no records anyway
+    }
+
+    void *map = mmap(NULL, gf->size, PROT_READ, MAP_PRIVATE, gf->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(gf->fd);
+        gf->fd = -1;
+        return -1;
+    }
+    madvise(map, gf->size, MADV_SEQUENTIAL);
+    gf->data = map;
+    return 0;
+}
+
+void grade_file_close(grade_file_t *gf)
+{
+    if (gf->resident)
+    {
+        gf->data = NULL;
+        gf->fd = -1;
+        return;
+    }
+    if (gf->data != NULL)
+    {
+        munmap((void *)gf->data, gf->size);
+        gf->data = NULL;
+    }
+    if (gf->fd != -1)
+    {
+        close(gf->fd);
+        gf->fd = -1;
+    }
+}
+
+// Create a file with a unique name next to path, to be written and then renamed over it.
+// Writers racing to replace the same file each get their own. mkstemp makes it 0600, so
+// it is given the mode that open(path, O_CREAT, 0666) would have.
+int grade_file_create_temp(const char *path, char *tmp_path, size_t size)
+{
+    snprintf(tmp_path, size, "%s.tmp.XXXXXX", path);
+    int fd = mkstemp(tmp_path);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    if (fchmod(fd, 0666 & ~mask) == -1)
+    {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    return fd;
+}
+
+// Drop the mapped pages before upto from memory once a scan is done with them
+void grade_file_release(grade_file_t *gf, size_t upto)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t len = upto - upto % page;
+    if (gf->data != NULL && len > 0 && !gf->resident)
+    {
+        madvise((void *)gf->data, len, MADV_DONTNEED);
+    }
+}
+
+// Split a line into name and grade at the last space. Returns -1 for lines that are not records.
+// A writer that died mid-append leaves a line ending in a NUL byte, which is no record.
+int parse_grade_record(const char *line, size_t len, grade_record_t *rec)
+{
+    if (len > 0 && line[len - 1] == '\r')
+    {
+        len--;
+    }
+    if (len > 0 && line[len - 1] == '\0')
+    {
+        return -1;
+    }
+
+    const char *last_space = scan_find_last(line, len, ' ');
+    size_t space = last_space != NULL ? (size_t)(last_space - line) + 1 : 0;
+    if (space <= 1 || space == len)
+    {
+        return -1;
+    }
+
+    rec->line = line;
+    rec->line_len = len;
+    rec->name = line;
+    rec->name_len = space - 1;
+    rec->grade = line + space;
+    rec->grade_len = len - space;
+    return 0;
+}
+
+// Parse the line starting at offset, which must be the first byte of a line
+int grade_file_record_at(const grade_file_t *gf, size_t offset, grade_record_t *rec)
+{
+    if (offset >= gf->size)
+    {
+        return -1;
+    }
+    const char *start = gf->data + offset;
+    const char *newline = scan_find(start, gf->size - offset, '\n');
+    size_t len = newline ? (size_t)(newline - start) : gf->size - offset;
+    return parse_grade_record(start, len, rec);
+}
+
+// Fetch the record starting at *cursor and advance the cursor past its newline.
+// Blank and malformed lines are skipped. Returns 0 once the end of the file is reached.
+int grade_file_next(const grade_file_t *gf, size_t *cursor, grade_record_t *rec)
+{
+    while (*cursor < gf->size)
+    {
+        const char *start = gf->data + *cursor;
+        size_t remaining = gf->size - *cursor;
+        const char *newline = scan_find(start, remaining, '\n');
+        size_t len = newline ? (size_t)(newline - start) : remaining;
+
+        *cursor += newline ? len + 1 : len;
+        if (parse_grade_record(start, len, rec) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
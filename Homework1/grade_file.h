@@ -0,0 +1,33 @@
+#ifndef GRADE_FILE_H
+#define GRADE_FILE_H
+
+#include <stddef.h>
+
+// Read-only mapping of a grades file shared by every command
+typedef struct {
+    int fd;
+    const char *data;   // NULL when the file is empty
+    size_t size;
+    int resident;       // mapping owned by the daemon cache, left alone by grade_file_close
+} grade_file_t;
+
+// One "Name Surname GRADE" line, pointing straight into the mapping
+typedef struct {
+    const char *line;   // start of the line
+    size_t line_len;    // length of the line without the newline
+    const char *name;   // everything before the last space
+    size_t name_len;
+    const char *grade;  // everything after the last space
+    size_t grade_len;
+} grade_record_t;
+
+int grade_file_open(grade_file_t *gf, const char *filename);
+void grade_file_close(grade_file_t *gf);
+void grade_file_set_resident(const char *filename, const grade_file_t *gf);
+void grade_file_release(grade_file_t *gf, size_t upto);
+int grade_file_create_temp(const char *path, char *tmp_path, size_t size);
+int grade_file_record_at(const grade_file_t *gf, size_t offset, grade_record_t *rec);
+int grade_file_next(const grade_file_t *gf, size_t *cursor, grade_record_t *rec);
+int parse_grade_record(const char *line, size_t len, grade_record_t *rec);
+
+#endif
@@ -0,0 +1,414 @@
+#include "grade_import.h"
+#include "byte_scan.h"
+#include "grade_file.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// One thread's byte range of a round and the records it normalized
+typedef struct {
+    const char *data;        // starts at a line start and ends after a newline or at EOF
+    size_t len;
+    char delimiter;
+    int header_allowed;      // the range starts the file, so its first line may be a header
+    char *out;               // normalized "name grade\n" lines, never longer than len + 1
+    size_t out_len;
+    size_t out_capacity;
+    uint64_t *starts;        // record starts within out
+    size_t starts_capacity;
+    uint64_t records;
+    uint64_t lines;
+    uint64_t rejected;
+    uint64_t first_rejected; // line within the range, counting from 1
+    int header;
+    int failed;
+} import_chunk_t;
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Name fields joined by single spaces, with quotes removed and runs of blanks collapsed
+static size_t copy_name(const char *field, size_t len, char delimiter, char *out)
+{
+    size_t n = 0;
+    int quoted = 0, pending = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = field[i];
+        if (c == '"')
+        {
+            if (!quoted || i + 1 == len || field[i + 1] != '"')
+            {
+                quoted = !quoted;
+                continue;
+            }
+            i++; // "" inside quotes is a literal quote
+        } else if (is_blank(c) || (c == delimiter && !quoted))
+        {
+            pending = n > 0;
+            continue;
+        } else if ((unsigned char)c < 0x20 || c == 0x7f)
+        {
+            return 0;
+        }
+        if (pending)
+        {
+            out[n++] = ' ';
+            pending = 0;
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+// One or two letters, upper-cased, with quotes and blanks removed
+static size_t copy_grade(const char *field, size_t len, char *out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = field[i];
+        if (c == '"' || is_blank(c))
+        {
+            continue;
+        }
+        if (c >= 'a' && c <= 'z')
+        {
+            c = (char)(c - 'a' + 'A');
+        }
+        if (c < 'A' || c > 'Z' || n == IMPORT_MAX_GRADE)
+        {
+            return 0;
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+// Write line as a "name grade\n" record to out. The grade is the last field and the name
+// is every field before it. Returns the record length, or 0 when the line is not a record.
+static size_t normalize_record(const char *line, size_t len, char delimiter, char *out)
+{
+    while (len > 0 && is_blank(line[len - 1]))
+    {
+        len--;
+    }
+
+    // Quoted fields may hold the delimiter, so the split is the last one outside quotes
+    size_t split = len;
+    int quoted = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (line[i] == '"')
+        {
+            quoted = !quoted;
+        } else if (line[i] == delimiter && !quoted)
+        {
+            split = i;
+        }
+    }
+    if (split == len || quoted)
+    {
+        return 0;
+    }
+
+    size_t name_len = copy_name(line, split, delimiter, out);
+    if (name_len == 0 || name_len > IMPORT_MAX_NAME)
+    {
+        return 0;
+    }
+    out[name_len] = ' ';
+    size_t grade_len = copy_grade(line + split + 1, len - split - 1, out + name_len + 1);
+    if (grade_len == 0)
+    {
+        return 0;
+    }
+    out[name_len + 1 + grade_len] = '\n';
+    return name_len + grade_len + 2;
+}
+
+static int blank_line(const char *line, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!is_blank(line[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void *import_chunk(void *arg)
+{
+    import_chunk_t *chunk = arg;
+    size_t pos = 0;
+
+    chunk->out_len = 0;
+    chunk->records = 0;
+    chunk->lines = 0;
+    chunk->rejected = 0;
+    chunk->first_rejected = 0;
+    chunk->header = 0;
+    chunk->failed = 0;
+
+    // Buffers are kept across rounds and only grow
+    size_t lines = scan_count(chunk->data, chunk->len, '\n') + 1;
+    if (chunk->out_capacity < chunk->len + 1)
+    {
+        free(chunk->out);
+        chunk->out = malloc(chunk->len + 1);
+        chunk->out_capacity = chunk->out != NULL ? chunk->len + 1 : 0;
+    }
+    if (chunk->starts_capacity < lines)
+    {
+        free(chunk->starts);
+        chunk->starts = malloc(lines * sizeof(uint64_t));
+        chunk->starts_capacity = chunk->starts != NULL ? lines : 0;
+    }
+    if (chunk->out == NULL || chunk->starts == NULL)
+    {
+        chunk->failed = 1;
+        return NULL;
+    }
+
+    while (pos < chunk->len)
+    {
+        const char *line = chunk->data + pos;
+        const char *newline = scan_find(line, chunk->len - pos, '\n');
+        size_t line_len = newline != NULL ? (size_t)(newline - line) : chunk->len - pos;
+        pos += line_len + 1;
+        chunk->lines++;
+
+        if (blank_line(line, line_len))
+        {
+            continue;
+        }
+        size_t len = normalize_record(line, line_len, chunk->delimiter, chunk->out + chunk->out_len);
+        if (len > 0)
+        {
+            chunk->starts[chunk->records++] = chunk->out_len;
+            chunk->out_len += len;
+        } else if (chunk->header_allowed)
+        {
+            chunk->header = 1; // a first line without a valid grade names the columns
+        } else
+        {
+            if (chunk->rejected++ == 0)
+            {
+                chunk->first_rejected = chunk->lines;
+            }
+        }
+        chunk->header_allowed = 0;
+    }
+    return NULL;
+}
+
+// Tab, comma or semicolon if the first non-blank line has one, "Name Surname GRADE" otherwise
+static char detect_delimiter(const char *data, size_t len)
+{
+    static const char candidates[] = { '\t', ',', ';' };
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const char *newline = scan_find(data + pos, len - pos, '\n');
+        size_t line_len = newline != NULL ? (size_t)(newline - data) - pos : len - pos;
+        if (!blank_line(data + pos, line_len))
+        {
+            for (size_t i = 0; i < sizeof(candidates); i++)
+            {
+                if (memchr(data + pos, candidates[i], line_len) != NULL)
+                {
+                    return candidates[i];
+                }
+            }
+            break;
+        }
+        pos += line_len + 1;
+    }
+    return ' ';
+}
+
+// Offset just past the line holding the byte before at
+static size_t line_end(const grade_file_t *gf, size_t at)
+{
+    if (at >= gf->size)
+    {
+        return gf->size;
+    }
+    const char *newline = scan_find(gf->data + at - 1, gf->size - (at - 1), '\n');
+    return newline != NULL ? (size_t)(newline - gf->data) + 1 : gf->size;
+}
+
+// Normalize one round of chunks in parallel; the calling thread takes the first chunk
+static void run_chunks(import_chunk_t *chunks, int count)
+{
+    pthread_t workers[IMPORT_MAX_THREADS];
+    int started[IMPORT_MAX_THREADS];
+
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&workers[i], NULL, import_chunk, &chunks[i]) == 0;
+        if (!started[i])
+        {
+            import_chunk(&chunks[i]);
+        }
+    }
+    import_chunk(&chunks[0]);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(workers[i], NULL);
+        }
+    }
+}
+
+// Append the valid records of input to target and its indexes. The input is cut into byte
+// ranges at line ends that threads validate and normalize; each round of ranges is then
+// appended in file order with a single write, so memory follows IMPORT_CHUNK_SIZE and
+// the thread count rather than the size of the input.
+int grade_import(const char *input, const char *target, int threads, sync_policy_t sync, import_report_t *report)
+{
+    grade_file_t gf;
+    import_chunk_t chunks[IMPORT_MAX_THREADS];
+    struct iovec parts[IMPORT_MAX_THREADS];
+    uint64_t *starts = NULL;
+    size_t starts_capacity = 0;
+    uint64_t lines = 0;
+    int result = 0;
+
+    memset(report, 0, sizeof(*report));
+    memset(chunks, 0, sizeof(chunks));
+    if (threads < 1)
+    {
+        threads = 1;
+    } else if (threads > IMPORT_MAX_THREADS)
+    {
+        threads = IMPORT_MAX_THREADS;
+    }
+
+    if (grade_file_open(&gf, input) == -1)
+    {
+        return -1;
+    }
+    append_writer_t *writer = malloc(sizeof(append_writer_t));
+    if (writer == NULL || append_open(writer, target, target, sync, 0) == -1)
+    {
+        free(writer);
+        grade_file_close(&gf);
+        return -1;
+    }
+
+    size_t pos = 0;
+    if (gf.size >= 3 && memcmp(gf.data, "\xef\xbb\xbf", 3) == 0)
+    {
+        pos = 3; // UTF-8 byte order mark
+    }
+    report->delimiter = detect_delimiter(gf.data + pos, gf.size - pos);
+
+    while (pos < gf.size && result == 0)
+    {
+        size_t round = gf.size - pos;
+        int used = threads;
+        if (round > (size_t)threads * IMPORT_CHUNK_SIZE)
+        {
+            round = (size_t)threads * IMPORT_CHUNK_SIZE;
+        } else if (round / IMPORT_MIN_CHUNK + 1 < (size_t)used)
+        {
+            used = (int)(round / IMPORT_MIN_CHUNK) + 1;
+        }
+
+        size_t start = pos;
+        for (int i = 0; i < used; i++)
+        {
+            size_t end = line_end(&gf, pos + round / used * (i + 1) + (i == used - 1 ? round % used : 0));
+            if (end < start)
+            {
+                end = start; // an earlier range already ran past this one
+            }
+            chunks[i].data = gf.data + start;
+            chunks[i].len = end - start;
+            chunks[i].delimiter = report->delimiter;
+            chunks[i].header_allowed = report->rounds == 0 && i == 0;
+            start = end;
+        }
+        run_chunks(chunks, used);
+
+        uint64_t records = 0;
+        for (int i = 0; i < used; i++)
+        {
+            if (chunks[i].failed)
+            {
+                errno = ENOMEM;
+                result = -1;
+            }
+            records += chunks[i].records;
+        }
+        if (result == -1)
+        {
+            break;
+        }
+        if (starts_capacity < records)
+        {
+            free(starts);
+            starts = malloc(records * sizeof(uint64_t));
+            starts_capacity = starts != NULL ? records : 0;
+            if (starts == NULL)
+            {
+                result = -1;
+                break;
+            }
+        }
+
+        // Rebase every range's record starts onto the round's single write
+        uint64_t base = 0, next = 0;
+        for (int i = 0; i < used; i++)
+        {
+            for (uint64_t r = 0; r < chunks[i].records; r++)
+            {
+                starts[next++] = base + chunks[i].starts[r];
+            }
+            parts[i].iov_base = chunks[i].out;
+            parts[i].iov_len = chunks[i].out_len;
+            base += chunks[i].out_len;
+
+            if (chunks[i].rejected > 0 && report->rejected == 0)
+            {
+                report->first_rejected = lines + chunks[i].first_rejected;
+            }
+            report->rejected += chunks[i].rejected;
+            report->header |= chunks[i].header;
+            lines += chunks[i].lines;
+        }
+        if (append_batch(writer, parts, used, starts, (size_t)records) == -1)
+        {
+            result = -1;
+            break;
+        }
+        report->imported += records;
+        report->bytes += base;
+        report->rounds++;
+
+        grade_file_release(&gf, start);
+        pos = start;
+    }
+
+    if (append_close(writer) == -1)
+    {
+        result = -1;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        free(chunks[i].out);
+        free(chunks[i].starts);
+    }
+    free(starts);
+    free(writer);
+    grade_file_close(&gf);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef GRADE_IMPORT_H
+#define GRADE_IMPORT_H
+
+#include <stdint.h>
+#include "append_writer.h"
+
+#define IMPORT_DEFAULT_THREADS 4
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_CHUNK_SIZE (8 * 1024 * 1024) // input bytes a thread normalizes per round
+#define IMPORT_MIN_CHUNK (64 * 1024)        // smaller inputs use fewer threads
+#define IMPORT_MAX_NAME 99                  // longest name that fits StudentGrade
+#define IMPORT_MAX_GRADE 2
+
+typedef struct {
+    char delimiter;          // detected field separator: '\t', ',', ';' or ' '
+    int header;              // the first line was a header and was skipped
+    uint64_t imported;
+    uint64_t rejected;       // non-blank lines that are not valid records
+    uint64_t first_rejected; // line number of the first of them, 0 if none
+    uint64_t bytes;          // bytes appended to the target
+    unsigned long rounds;    // appends issued, one per round of threads
+} import_report_t;
+
+int grade_import(const char *input, const char *target, int threads, sync_policy_t sync, import_report_t *report);
+
+#endif
@@ -0,0 +1,894 @@
+#include "grade_index.h"
+#include "byte_scan.h"
+#include "record_lock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_VERSION 2
+
+// qsort has no context argument, so the file being indexed is kept here while sorting
+static const grade_file_t *sort_file = NULL;
+
+// Indexes kept mapped by the daemon, handed out by name_index_open and line_index_range
+static name_index_t resident_names;
+static char resident_names_name[256];
+static line_index_t resident_lines;
+static char resident_lines_name[256];
+
+void index_path(char *buffer, size_t size, const char *filename, const char *suffix)
+{
+    snprintf(buffer, size, "%s%s", filename, suffix);
+}
+
+// Same ordering as strcmp on the NUL-terminated names
+int compare_names(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    size_t n = a_len < b_len ? a_len : b_len;
+    int result = memcmp(a, b, n);
+    if (result != 0)
+    {
+        return result;
+    }
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+static void name_at(const grade_file_t *gf, uint64_t offset, const char **name, size_t *len)
+{
+    grade_record_t rec;
+    if (grade_file_record_at(gf, offset, &rec) == 0)
+    {
+        *name = rec.name;
+        *len = rec.name_len;
+    } else
+    {
+        *name = "";
+        *len = 0;
+    }
+}
+
+static int compare_entries(const grade_file_t *gf, uint64_t a, uint64_t b)
+{
+    const char *name_a, *name_b;
+    size_t len_a, len_b;
+    name_at(gf, a, &name_a, &len_a);
+    name_at(gf, b, &name_b, &len_b);
+
+    int result = compare_names(name_a, len_a, name_b, len_b);
+    if (result != 0)
+    {
+        return result;
+    }
+    return (a > b) - (a < b);
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+    return compare_entries(sort_file, *(const uint64_t *)a, *(const uint64_t *)b);
+}
+
+static int write_full(int fd, const void *data, size_t len, off_t offset)
+{
+    const char *ptr = data;
+    while (len > 0)
+    {
+        ssize_t written = pwrite(fd, ptr, len, offset);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        ptr += written;
+        len -= (size_t)written;
+        offset += written;
+    }
+    return 0;
+}
+
+// FNV-1a over the first INDEX_SOURCE_PREFIX bytes of [0, covered_size) of the grades file fd
+static int hash_prefix(int fd, uint64_t covered_size, uint64_t *len, uint64_t *hash)
+{
+    unsigned char prefix[INDEX_SOURCE_PREFIX];
+    size_t want = covered_size < sizeof(prefix) ? (size_t)covered_size : sizeof(prefix);
+    size_t got = 0;
+    while (got < want)
+    {
+        ssize_t n = pread(fd, prefix + got, want - got, (off_t)got);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    *hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < want; i++)
+    {
+        *hash = (*hash ^ prefix[i]) * 0x100000001b3ULL;
+    }
+    *len = want;
+    return 0;
+}
+
+// Identity of the grades file fd, as seen by an index covering covered_size bytes of it
+static int source_of(int fd, uint64_t covered_size, index_source_t *source)
+{
+    struct stat st;
+    memset(source, 0, sizeof(*source));
+    if (fstat(fd, &st) == -1)
+    {
+        return -1;
+    }
+    source->dev = (uint64_t)st.st_dev;
+    source->ino = (uint64_t)st.st_ino;
+    return hash_prefix(fd, covered_size, &source->prefix_len, &source->prefix_hash);
+}
+
+// Whether an index built from source still describes the grades file fd
+static int source_matches(int fd, const index_source_t *source)
+{
+    index_source_t current;
+    return source_of(fd, source->prefix_len, &current) == 0 && current.dev == source->dev &&
+           current.ino == source->ino && current.prefix_len == source->prefix_len &&
+           current.prefix_hash == source->prefix_hash;
+}
+
+// Replace the file at path with header followed by entries, through a temporary file of its
+// own, so readers never see it half written and concurrent builders never write into one file
+static int replace_index(const char *path, const void *header, size_t header_size, const uint64_t *entries, uint64_t count)
+{
+    char tmp_path[512];
+    int fd = grade_file_create_temp(path, tmp_path, sizeof(tmp_path));
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (write_full(fd, header, header_size, 0) == -1 ||
+        write_full(fd, entries, count * sizeof(uint64_t), (off_t)header_size) == -1)
+    {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    if (close(fd) == -1 || rename(tmp_path, path) == -1)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Replace the index with a fully sorted run of the grades file fd
+static int write_index(const char *path, int fd, const uint64_t *entries, uint64_t count, uint64_t covered_size)
+{
+    name_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NAME_INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.covered_size = covered_size;
+    header.sorted_count = count;
+    header.tail_count = 0;
+    if (source_of(fd, covered_size, &header.source) == -1)
+    {
+        return -1;
+    }
+    return replace_index(path, &header, sizeof(header), entries, count);
+}
+
+static int load_index(name_index_t *ni, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(name_index_header_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    memcpy(&ni->header, map, sizeof(ni->header));
+    ni->map = map;
+    ni->map_size = (size_t)st.st_size;
+    ni->entries = (const uint64_t *)((const char *)map + sizeof(name_index_header_t));
+
+    uint64_t capacity = (ni->map_size - sizeof(name_index_header_t)) / sizeof(uint64_t);
+    if (memcmp(ni->header.magic, NAME_INDEX_MAGIC, sizeof(ni->header.magic)) != 0 ||
+        ni->header.version != INDEX_VERSION ||
+        ni->header.sorted_count + ni->header.tail_count > capacity)
+    {
+        name_index_close(ni);
+        return -1;
+    }
+    return 0;
+}
+
+// Sort every record of the file and write a fresh index
+static int build_index(const char *path, const grade_file_t *gf)
+{
+    size_t capacity = 1024, count = 0, cursor = 0;
+    grade_record_t rec;
+    uint64_t *entries = malloc(capacity * sizeof(uint64_t));
+    if (entries == NULL)
+    {
+        return -1;
+    }
+
+    while (grade_file_next(gf, &cursor, &rec))
+    {
+        if (count == capacity)
+        {
+            capacity *= 2;
+            uint64_t *grown = realloc(entries, capacity * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                free(entries);
+                return -1;
+            }
+            entries = grown;
+        }
+        entries[count++] = (uint64_t)(rec.line - gf->data);
+    }
+
+    sort_file = gf;
+    qsort(entries, count, sizeof(uint64_t), compare_offsets);
+    int result = write_index(path, gf->fd, entries, count, gf->size);
+    free(entries);
+    return result;
+}
+
+// Open an index to update it in place. The write lock lasts until fd is closed, so appenders
+// of one index take turns and each sees the header the previous one left.
+static int open_locked(const char *path)
+{
+    int fd = open(path, O_RDWR);
+    if (fd != -1 && record_lock(fd, F_WRLCK, 0, 0) == -1)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// Index the records appended after covered_size by adding them to the tail
+static int catch_up(const char *path, const grade_file_t *gf)
+{
+    name_index_header_t header;
+    grade_record_t rec;
+
+    int fd = open_locked(path);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    // The header is read again under the lock: another process may have caught up meanwhile
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, NAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.covered_size >= gf->size)
+    {
+        close(fd);
+        return 0;
+    }
+
+    uint64_t batch[4096];
+    size_t batched = 0;
+    int result = 0;
+    size_t cursor = (size_t)header.covered_size;
+    uint64_t position = header.sorted_count + header.tail_count;
+    while (result == 0 && grade_file_next(gf, &cursor, &rec))
+    {
+        batch[batched++] = (uint64_t)(rec.line - gf->data);
+        if (batched == sizeof(batch) / sizeof(batch[0]))
+        {
+            result = write_full(fd, batch, batched * sizeof(uint64_t), sizeof(header) + position * sizeof(uint64_t));
+            position += batched;
+            header.tail_count += batched;
+            batched = 0;
+        }
+    }
+    if (result == 0 && batched > 0)
+    {
+        result = write_full(fd, batch, batched * sizeof(uint64_t), sizeof(header) + position * sizeof(uint64_t));
+        header.tail_count += batched;
+    }
+
+    // Entries go first and the header last, so an interrupted update only loses work
+    header.covered_size = gf->size;
+    if (result == 0)
+    {
+        result = source_of(gf->fd, gf->size, &header.source);
+    }
+    if (result == 0)
+    {
+        result = write_full(fd, &header, sizeof(header), 0);
+    }
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+// Sort the tail and merge it with the sorted run: O(n + k log k) for k appended entries
+static int merge_entries(const name_index_t *ni, const grade_file_t *gf, uint64_t **merged_out, uint64_t *count_out)
+{
+    uint64_t sorted_count = ni->header.sorted_count;
+    uint64_t tail_count = ni->header.tail_count;
+    uint64_t *tail = malloc((tail_count > 0 ? tail_count : 1) * sizeof(uint64_t));
+    uint64_t *merged = malloc((sorted_count + tail_count > 0 ? sorted_count + tail_count : 1) * sizeof(uint64_t));
+    if (tail == NULL || merged == NULL)
+    {
+        free(tail);
+        free(merged);
+        return -1;
+    }
+
+    memcpy(tail, ni->entries + sorted_count, tail_count * sizeof(uint64_t));
+    sort_file = gf;
+    qsort(tail, tail_count, sizeof(uint64_t), compare_offsets);
+
+    uint64_t i = 0, j = 0, k = 0;
+    while (i < sorted_count && j < tail_count)
+    {
+        if (compare_entries(gf, ni->entries[i], tail[j]) <= 0)
+        {
+            merged[k++] = ni->entries[i++];
+        } else
+        {
+            merged[k++] = tail[j++];
+        }
+    }
+    while (i < sorted_count)
+    {
+        merged[k++] = ni->entries[i++];
+    }
+    while (j < tail_count)
+    {
+        merged[k++] = tail[j++];
+    }
+
+    free(tail);
+    *merged_out = merged;
+    *count_out = k;
+    return 0;
+}
+
+// Fold the tail into the sorted run on disk
+static int merge_tail(const char *path, const name_index_t *ni, const grade_file_t *gf)
+{
+    uint64_t *merged, count;
+    if (merge_entries(ni, gf, &merged, &count) == -1)
+    {
+        return -1;
+    }
+    int result = write_index(path, gf->fd, merged, count, ni->header.covered_size);
+    free(merged);
+    return result;
+}
+
+// Open the index of filename, building it on first use and bringing it up to date with gf
+int name_index_open(name_index_t *ni, const char *filename, const grade_file_t *gf)
+{
+    char path[512];
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+
+    if (resident_names.map != NULL && resident_names.header.covered_size == gf->size &&
+        strcmp(resident_names_name, filename) == 0)
+    {
+        *ni = resident_names;
+        return 0;
+    }
+
+    ni->map = NULL;
+    ni->resident = 0;
+    if (load_index(ni, path) == 0 && (ni->header.covered_size > gf->size || !source_matches(gf->fd, &ni->header.source)))
+    {
+        name_index_close(ni); // the file shrank or was replaced, offsets can no longer be trusted
+    }
+    if (ni->map == NULL)
+    {
+        if (build_index(path, gf) == -1 || load_index(ni, path) == -1)
+        {
+            return -1;
+        }
+    }
+
+    if (ni->header.covered_size < gf->size)
+    {
+        int result = catch_up(path, gf);
+        name_index_close(ni);
+        if (result == -1 || load_index(ni, path) == -1)
+        {
+            return -1;
+        }
+    }
+
+    if (ni->header.tail_count > NAME_INDEX_TAIL_LIMIT)
+    {
+        int result = merge_tail(path, ni, gf);
+        name_index_close(ni);
+        if (result == -1 || load_index(ni, path) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void name_index_close(name_index_t *ni)
+{
+    if (ni->map != NULL && !ni->resident)
+    {
+        munmap(ni->map, ni->map_size);
+    }
+    ni->map = NULL;
+}
+
+// Let name_index_open reuse ni for filename instead of mapping the index again. NULL forgets it.
+void name_index_set_resident(const char *filename, const name_index_t *ni)
+{
+    if (filename == NULL || ni == NULL)
+    {
+        resident_names.map = NULL;
+        return;
+    }
+    snprintf(resident_names_name, sizeof(resident_names_name), "%s", filename);
+    resident_names = *ni;
+    resident_names.resident = 1;
+}
+
+// Find the first record in file order whose name matches. Returns 1 when found.
+int name_index_lookup(const name_index_t *ni, const grade_file_t *gf, const char *name, size_t len, uint64_t *offset)
+{
+    const char *candidate;
+    size_t candidate_len;
+    uint64_t low = 0, high = ni->header.sorted_count;
+
+    // Lower bound of name in the sorted run
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        name_at(gf, ni->entries[mid], &candidate, &candidate_len);
+        if (compare_names(candidate, candidate_len, name, len) < 0)
+        {
+            low = mid + 1;
+        } else
+        {
+            high = mid;
+        }
+    }
+    if (low < ni->header.sorted_count)
+    {
+        name_at(gf, ni->entries[low], &candidate, &candidate_len);
+        if (compare_names(candidate, candidate_len, name, len) == 0)
+        {
+            *offset = ni->entries[low];
+            return 1;
+        }
+    }
+
+    // Tail entries were appended after the sorted run was written, so they come later in the file
+    for (uint64_t i = 0; i < ni->header.tail_count; i++)
+    {
+        uint64_t entry = ni->entries[ni->header.sorted_count + i];
+        name_at(gf, entry, &candidate, &candidate_len);
+        if (compare_names(candidate, candidate_len, name, len) == 0)
+        {
+            *offset = entry;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Replace the name index of filename, open as fd, with entries that are already in (name, offset) order
+int name_index_write(const char *filename, int fd, const uint64_t *entries, uint64_t count, uint64_t covered_size)
+{
+    char path[512];
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+    return write_index(path, fd, entries, count, covered_size);
+}
+
+// Open the index of filename with its tail folded into the sorted run, so that the entries
+// list every record in (name, offset) order. Only the k entries appended since the run was
+// last written are sorted, and the merged run replaces the index: O(n + k log k) once, then
+// O(n) for every reader until the next append.
+int name_index_open_sorted(name_index_t *ni, const char *filename, const grade_file_t *gf)
+{
+    char path[512];
+    if (name_index_open(ni, filename, gf) == -1)
+    {
+        return -1;
+    }
+    if (ni->header.tail_count == 0)
+    {
+        return 0;
+    }
+
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+    int result = merge_tail(path, ni, gf);
+    name_index_close(ni);
+    if (result == -1 || load_index(ni, path) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Entries name_index_open_sorted would load for gf, found without loading or building
+// anything: the counts in the index header plus the lines written after it, or every line
+// of the file when there is no usable index
+uint64_t name_index_expected_count(const char *filename, const grade_file_t *gf)
+{
+    char path[512];
+    name_index_header_t header;
+    uint64_t count = 0;
+    size_t covered = 0;
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+
+    int fd = open(path, O_RDONLY);
+    if (fd != -1)
+    {
+        if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, NAME_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == INDEX_VERSION && header.covered_size <= gf->size)
+        {
+            covered = (size_t)header.covered_size;
+            count = header.sorted_count + header.tail_count;
+        }
+        close(fd);
+    }
+    if (covered < gf->size)
+    {
+        count += scan_count(gf->data + covered, gf->size - covered, '\n');
+        count += gf->data[gf->size - 1] != '\n'; // last line without its newline
+    }
+    return count;
+}
+
+// Record count lines appended at offsets, the first one at the old end of the file. An index that
+// is missing or already behind the file is left alone; the next name_index_open catches it up.
+int name_index_append(const char *filename, const uint64_t *offsets, size_t count, uint64_t new_size)
+{
+    char path[512];
+    name_index_header_t header;
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+
+    int fd = open_locked(path);
+    if (fd == -1)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, NAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.covered_size != offsets[0])
+    {
+        close(fd);
+        return 0;
+    }
+
+    uint64_t position = header.sorted_count + header.tail_count;
+    int result = write_full(fd, offsets, count * sizeof(uint64_t), sizeof(header) + position * sizeof(uint64_t));
+    if (result == 0)
+    {
+        header.tail_count += count;
+        header.covered_size = new_size;
+        result = write_full(fd, &header, sizeof(header), 0);
+    }
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+static int load_line_header(int fd, line_index_header_t *header)
+{
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) ||
+        memcmp(header->magic, LINE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != INDEX_VERSION)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Write the line starts found in [covered_size, size) of the grades file after the entries
+// already in the line index fd, then the header that counts them
+static int write_line_starts(int fd, const grade_file_t *gf, line_index_header_t *header)
+{
+    uint64_t batch[4096];
+    size_t batched = 0;
+    int result = 0;
+    size_t pos = (size_t)header->covered_size;
+    uint64_t position = header->line_count;
+    while (pos < gf->size && result == 0)
+    {
+        // A line starts wherever the previous byte is a newline
+        if (pos == 0 || gf->data[pos - 1] == '\n')
+        {
+            batch[batched++] = pos;
+        }
+        const char *newline = scan_find(gf->data + pos, gf->size - pos, '\n');
+        pos = newline ? (size_t)(newline - gf->data) + 1 : gf->size;
+
+        if (batched == sizeof(batch) / sizeof(batch[0]) || pos >= gf->size)
+        {
+            result = write_full(fd, batch, batched * sizeof(uint64_t), sizeof(*header) + position * sizeof(uint64_t));
+            position += batched;
+            batched = 0;
+        }
+    }
+
+    // Entries go first and the header last, so an interrupted update only loses work
+    if (result == 0)
+    {
+        header->covered_size = gf->size;
+        header->line_count = position;
+        result = source_of(gf->fd, gf->size, &header->source);
+    }
+    if (result == 0)
+    {
+        result = write_full(fd, header, sizeof(*header), 0);
+    }
+    return result;
+}
+
+// Add the line starts found in [covered_size, size) of the grades file to the line index.
+// An index that is missing or no longer matches the file is built from scratch in a file of
+// its own and renamed into place, so readers that have the old one mapped keep a whole file.
+static int line_index_sync(const char *filename, const char *path)
+{
+    grade_file_t gf;
+    line_index_header_t header;
+    char tmp_path[512];
+    int result;
+
+    if (grade_file_open(&gf, filename) == -1)
+    {
+        return -1;
+    }
+    int fd = open_locked(path);
+    if (fd != -1 && load_line_header(fd, &header) == 0 && header.covered_size <= gf.size && source_matches(gf.fd, &header.source))
+    {
+        result = write_line_starts(fd, &gf, &header);
+        if (close(fd) == -1)
+        {
+            result = -1;
+        }
+        grade_file_close(&gf);
+        return result;
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    fd = grade_file_create_temp(path, tmp_path, sizeof(tmp_path));
+    if (fd == -1)
+    {
+        grade_file_close(&gf);
+        return -1;
+    }
+    result = write_line_starts(fd, &gf, &header);
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    if (result == 0)
+    {
+        result = rename(tmp_path, path);
+    }
+    if (result == -1)
+    {
+        unlink(tmp_path);
+    }
+    grade_file_close(&gf);
+    return result;
+}
+
+// Open the line index of filename, bringing it up to date first when it does not cover
+// file_size of the grades file grades_fd
+static int open_line_index(const char *filename, int grades_fd, uint64_t file_size, line_index_header_t *header)
+{
+    char path[512];
+    index_path(path, sizeof(path), filename, LINE_INDEX_SUFFIX);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || load_line_header(fd, header) == -1 || header->covered_size != file_size ||
+        !source_matches(grades_fd, &header->source))
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        if (line_index_sync(filename, path) == -1)
+        {
+            return -1;
+        }
+        fd = open(path, O_RDONLY);
+        if (fd == -1 || load_line_header(fd, header) == -1)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            return -1;
+        }
+        // The sync indexed filename as it is now, which may no longer be the file in grades_fd
+        if (!source_matches(grades_fd, &header->source))
+        {
+            close(fd);
+            errno = ESTALE;
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Map the whole line index so lookups need no system calls at all
+int line_index_open(line_index_t *li, const char *filename, int grades_fd, uint64_t file_size)
+{
+    struct stat st;
+    li->map = NULL;
+    li->resident = 0;
+
+    int fd = open_line_index(filename, grades_fd, file_size, &li->header);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 ||
+        (uint64_t)st.st_size < sizeof(line_index_header_t) + li->header.line_count * sizeof(uint64_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    li->map = map;
+    li->map_size = (size_t)st.st_size;
+    li->offsets = (const uint64_t *)((const char *)map + sizeof(line_index_header_t));
+    return 0;
+}
+
+void line_index_close(line_index_t *li)
+{
+    if (li->map != NULL && !li->resident)
+    {
+        munmap(li->map, li->map_size);
+    }
+    li->map = NULL;
+}
+
+void line_index_set_resident(const char *filename, const line_index_t *li)
+{
+    if (filename == NULL || li == NULL)
+    {
+        resident_lines.map = NULL;
+        return;
+    }
+    snprintf(resident_lines_name, sizeof(resident_lines_name), "%s", filename);
+    resident_lines = *li;
+    resident_lines.resident = 1;
+}
+
+// Byte range [start, end) of lines first .. first + count - 1. Returns 0 when first is past the last line.
+int line_index_range(const char *filename, int grades_fd, uint64_t file_size, uint64_t first, uint64_t count, uint64_t *start, uint64_t *end)
+{
+    line_index_header_t header;
+
+    if (resident_lines.map != NULL && resident_lines.header.covered_size == file_size &&
+        strcmp(resident_lines_name, filename) == 0)
+    {
+        if (first >= resident_lines.header.line_count)
+        {
+            return 0;
+        }
+        *start = resident_lines.offsets[first];
+        *end = count < resident_lines.header.line_count - first ? resident_lines.offsets[first + count] : file_size;
+        return 1;
+    }
+
+    int fd = open_line_index(filename, grades_fd, file_size, &header);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    int result = 0;
+    if (first < header.line_count)
+    {
+        result = 1;
+        *end = header.covered_size;
+        if (pread(fd, start, sizeof(*start), sizeof(header) + first * sizeof(uint64_t)) != (ssize_t)sizeof(*start) ||
+            (count < header.line_count - first &&
+             pread(fd, end, sizeof(*end), sizeof(header) + (first + count) * sizeof(uint64_t)) != (ssize_t)sizeof(*end)))
+        {
+            result = -1;
+        }
+    }
+    close(fd);
+    return result;
+}
+
+// Replace the line index of filename, open as grades_fd, with the given line starts
+int line_index_write(const char *filename, int grades_fd, const uint64_t *offsets, uint64_t count, uint64_t covered_size)
+{
+    char path[512];
+    line_index_header_t header;
+    index_path(path, sizeof(path), filename, LINE_INDEX_SUFFIX);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.covered_size = covered_size;
+    header.line_count = count;
+    if (source_of(grades_fd, covered_size, &header.source) == -1)
+    {
+        return -1;
+    }
+    return replace_index(path, &header, sizeof(header), offsets, count);
+}
+
+// Record count lines appended at offsets. Like name_index_append, a missing or stale index is left for the next reader.
+int line_index_append(const char *filename, const uint64_t *offsets, size_t count, uint64_t new_size)
+{
+    char path[512];
+    line_index_header_t header;
+    index_path(path, sizeof(path), filename, LINE_INDEX_SUFFIX);
+
+    int fd = open_locked(path);
+    if (fd == -1)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (load_line_header(fd, &header) == -1 || header.covered_size != offsets[0])
+    {
+        close(fd);
+        return 0;
+    }
+
+    int result = write_full(fd, offsets, count * sizeof(uint64_t), sizeof(header) + header.line_count * sizeof(uint64_t));
+    if (result == 0)
+    {
+        header.line_count += count;
+        header.covered_size = new_size;
+        result = write_full(fd, &header, sizeof(header), 0);
+    }
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    return result;
+}
@@ -0,0 +1,79 @@
+#ifndef GRADE_INDEX_H
+#define GRADE_INDEX_H
+
+#include <stdint.h>
+#include "grade_file.h"
+
+#define NAME_INDEX_SUFFIX ".idx"
+#define NAME_INDEX_MAGIC "GIDX"
+#define NAME_INDEX_TAIL_LIMIT 4096 // appended entries tolerated before they are merged into the sorted run
+#define INDEX_SOURCE_PREFIX 4096   // leading bytes of the grades file an index is checked against
+
+// The grades file an index was built from. Appends keep it; a file renamed over the old
+// one, or rewritten in place with other contents, no longer matches and is indexed again.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t prefix_len;  // bytes hashed, the first INDEX_SOURCE_PREFIX of what was covered
+    uint64_t prefix_hash;
+} index_source_t;
+
+// On-disk header of a name index. It is followed by sorted_count offsets ordered
+// by (name, offset) and then tail_count offsets in the order they were appended.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t covered_size; // bytes of the grades file described by the index
+    uint64_t sorted_count;
+    uint64_t tail_count;
+    index_source_t source;
+} name_index_header_t;
+
+#define LINE_INDEX_SUFFIX ".lines"
+#define LINE_INDEX_MAGIC "GLIX"
+
+// On-disk header of a line index, followed by the byte offset of each line start
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t covered_size;
+    uint64_t line_count;
+    index_source_t source;
+} line_index_header_t;
+
+typedef struct {
+    name_index_header_t header;
+    const uint64_t *entries; // sorted run followed by the tail
+    void *map;
+    size_t map_size;
+    int resident; // shared with the daemon cache, never unmapped by name_index_close
+} name_index_t;
+
+typedef struct {
+    line_index_header_t header;
+    const uint64_t *offsets;
+    void *map;
+    size_t map_size;
+    int resident;
+} line_index_t;
+
+void index_path(char *buffer, size_t size, const char *filename, const char *suffix);
+int compare_names(const char *a, size_t a_len, const char *b, size_t b_len);
+
+int name_index_open(name_index_t *ni, const char *filename, const grade_file_t *gf);
+int name_index_open_sorted(name_index_t *ni, const char *filename, const grade_file_t *gf);
+uint64_t name_index_expected_count(const char *filename, const grade_file_t *gf);
+void name_index_close(name_index_t *ni);
+void name_index_set_resident(const char *filename, const name_index_t *ni);
+int name_index_lookup(const name_index_t *ni, const grade_file_t *gf, const char *name, size_t len, uint64_t *offset);
+int name_index_append(const char *filename, const uint64_t *offsets, size_t count, uint64_t new_size);
+int name_index_write(const char *filename, int fd, const uint64_t *entries, uint64_t count, uint64_t covered_size);
+
+int line_index_open(line_index_t *li, const char *filename, int fd, uint64_t file_size);
+void line_index_close(line_index_t *li);
+void line_index_set_resident(const char *filename, const line_index_t *li);
+int line_index_range(const char *filename, int fd, uint64_t file_size, uint64_t first, uint64_t count, uint64_t *start, uint64_t *end);
+int line_index_write(const char *filename, int fd, const uint64_t *offsets, uint64_t count, uint64_t covered_size);
+int line_index_append(const char *filename, const uint64_t *offsets, size_t count, uint64_t new_size);
+
+#endif
@@ -0,0 +1,1211 @@
+#include "grade_sort.h"
+#include "byte_scan.h"
+#include "grade_index.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Sorted run on disk, read back in buffered chunks during the merge
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t size;
+    size_t start;
+    size_t end;
+    int eof;
+    int index; // position of the run, used to keep the merge stable
+    StudentGrade current;
+} run_reader_t;
+
+// Record of a run being filled in memory. offset is where the line sits in the grades file,
+// so records that compare equal keep file order like the key sort does.
+typedef struct {
+    StudentGrade grade;
+    uint64_t offset;
+} run_record_t;
+
+// qsort has no context argument, so the comparator of the run being sorted is kept here
+static compare_fn run_compare = NULL;
+
+static int put_fields(out_buffer_t *out, const char *name, size_t name_len, const char *grade, size_t grade_len)
+{
+    if (out_write(out, name, name_len) == -1 || out_write(out, " ", 1) == -1 ||
+        out_write(out, grade, grade_len) == -1 || out_write(out, "\n", 1) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int put_record(out_buffer_t *out, const StudentGrade *grade)
+{
+    return put_fields(out, grade->name, strlen(grade->name), grade->grade, strlen(grade->grade));
+}
+
+static void fill_grade(StudentGrade *grade, const grade_record_t *rec)
+{
+    snprintf(grade->name, sizeof(grade->name), "%.*s", (int)rec->name_len, rec->name);
+    snprintf(grade->grade, sizeof(grade->grade), "%.*s", (int)rec->grade_len, rec->grade);
+}
+
+// Anonymous temporary file: unlinked right away so runs disappear even if sortAll dies
+static int create_run_file(void)
+{
+    char path[512];
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/gtuStudentGrades.run.XXXXXX", dir != NULL ? dir : "/tmp");
+
+    int fd = mkstemp(path);
+    if (fd != -1)
+    {
+        unlink(path);
+    }
+    return fd;
+}
+
+static int rewind_run(int fd)
+{
+    return lseek(fd, 0, SEEK_SET) == -1 ? -1 : 0;
+}
+
+static int compare_run_records(const void *a, const void *b)
+{
+    const run_record_t *record_a = a;
+    const run_record_t *record_b = b;
+    int result = run_compare(&record_a->grade, &record_b->grade);
+    if (result == 0)
+    {
+        result = (record_a->offset > record_b->offset) - (record_a->offset < record_b->offset);
+    }
+    return result;
+}
+
+static void sort_run(run_record_t *records, size_t count, compare_fn compare)
+{
+    run_compare = compare;
+    qsort(records, count, sizeof(run_record_t), compare_run_records);
+}
+
+static int spill_run(const run_record_t *records, size_t count)
+{
+    out_buffer_t w;
+    int fd = create_run_file();
+    if (fd == -1)
+    {
+        return -1;
+    }
+    out_init(&w, fd);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (put_record(&w, &records[i].grade) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    if (out_flush(&w) == -1 || rewind_run(fd) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Load the next line of the run into current. Returns 1 on success, 0 at the end of the run.
+static int reader_next(run_reader_t *r)
+{
+    while (1)
+    {
+        char *newline = (char *)scan_find(r->buffer + r->start, r->end - r->start, '\n');
+        if (newline != NULL || (r->eof && r->start < r->end))
+        {
+            size_t len = newline ? (size_t)(newline - (r->buffer + r->start)) : r->end - r->start;
+            grade_record_t rec;
+            const char *line = r->buffer + r->start;
+            r->start += newline ? len + 1 : len;
+            if (parse_grade_record(line, len, &rec) == 0)
+            {
+                fill_grade(&r->current, &rec);
+                return 1;
+            }
+            continue;
+        }
+        if (r->eof)
+        {
+            return 0;
+        }
+
+        // Keep the partial line and refill the rest of the buffer
+        memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+        if (r->end == r->size)
+        {
+            errno = EOVERFLOW; // a single line longer than the read buffer
+            return -1;
+        }
+        ssize_t bytes_read = read(r->fd, r->buffer + r->end, r->size - r->end);
+        if (bytes_read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (bytes_read == 0)
+        {
+            r->eof = 1;
+        }
+        r->end += (size_t)bytes_read;
+    }
+}
+
+static int reader_less(compare_fn compare, const run_reader_t *a, const run_reader_t *b)
+{
+    int result = compare(&a->current, &b->current);
+    return result < 0 || (result == 0 && a->index < b->index);
+}
+
+static void heap_sift_down(run_reader_t **heap, size_t count, size_t i, compare_fn compare)
+{
+    while (1)
+    {
+        size_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && reader_less(compare, heap[left], heap[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < count && reader_less(compare, heap[right], heap[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == i)
+        {
+            return;
+        }
+        run_reader_t *tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// k-way merge of sorted runs into out using a min-heap of run heads. The run fds are closed.
+static int merge_runs(const int *fds, size_t count, compare_fn compare, size_t buffer_size, out_buffer_t *out)
+{
+    run_reader_t *readers = calloc(count, sizeof(run_reader_t));
+    run_reader_t **heap = calloc(count, sizeof(run_reader_t *));
+    size_t heap_count = 0;
+    int result = 0;
+
+    if (readers == NULL || heap == NULL)
+    {
+        result = -1;
+    }
+    for (size_t i = 0; i < count && result == 0; i++)
+    {
+        readers[i].fd = fds[i];
+        readers[i].size = buffer_size;
+        readers[i].index = (int)i;
+        readers[i].buffer = malloc(buffer_size);
+        if (readers[i].buffer == NULL)
+        {
+            result = -1;
+            break;
+        }
+        int loaded = reader_next(&readers[i]);
+        if (loaded == -1)
+        {
+            result = -1;
+        } else if (loaded == 1)
+        {
+            heap[heap_count++] = &readers[i];
+        }
+    }
+
+    if (result == 0)
+    {
+        for (size_t i = heap_count; i-- > 0;)
+        {
+            heap_sift_down(heap, heap_count, i, compare);
+        }
+    }
+    while (result == 0 && heap_count > 0)
+    {
+        if (put_record(out, &heap[0]->current) == -1)
+        {
+            result = -1;
+            break;
+        }
+        int loaded = reader_next(heap[0]);
+        if (loaded == -1)
+        {
+            result = -1;
+            break;
+        }
+        if (loaded == 0)
+        {
+            heap[0] = heap[--heap_count];
+        }
+        heap_sift_down(heap, heap_count, 0, compare);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        close(fds[i]);
+        if (readers != NULL)
+        {
+            free(readers[i].buffer);
+        }
+    }
+    free(readers);
+    free(heap);
+    return result;
+}
+
+// Merge groups of fan_in runs into longer runs until one final merge is left
+static int reduce_runs(int *fds, size_t *count, size_t fan_in, compare_fn compare, size_t buffer_size)
+{
+    while (*count > fan_in)
+    {
+        size_t merged = 0;
+        for (size_t first = 0; first < *count; first += fan_in)
+        {
+            size_t group = *count - first < fan_in ? *count - first : fan_in;
+            out_buffer_t w;
+            int fd = create_run_file();
+            if (fd == -1)
+            {
+                return -1;
+            }
+            out_init(&w, fd);
+            int result = merge_runs(fds + first, group, compare, buffer_size, &w);
+            if (result == 0)
+            {
+                result = out_flush(&w);
+            }
+            if (result == -1 || rewind_run(fd) == -1)
+            {
+                close(fd);
+                return -1;
+            }
+            fds[merged++] = fd;
+        }
+        *count = merged;
+    }
+    return 0;
+}
+
+static int push_run(int **runs, size_t *count, size_t *capacity, int fd)
+{
+    if (*count == *capacity)
+    {
+        int *grown = realloc(*runs, *capacity * 2 * sizeof(int));
+        if (grown == NULL)
+        {
+            close(fd);
+            return -1;
+        }
+        *runs = grown;
+        *capacity *= 2;
+    }
+    (*runs)[(*count)++] = fd;
+    return 0;
+}
+
+// Sort every record of gf with compare and queue them on out as "name grade" lines.
+// At most memory_budget bytes of records are held at once; larger inputs are cut into
+// sorted runs on temporary files and k-way merged. Records that compare equal keep file order.
+int external_sort(grade_file_t *gf, compare_fn compare, size_t memory_budget, out_buffer_t *out)
+{
+    size_t capacity = memory_budget / sizeof(run_record_t);
+    size_t count = 0, cursor = 0, run_count = 0, run_capacity = 16;
+    grade_record_t rec;
+
+    if (capacity < MIN_RUN_RECORDS)
+    {
+        capacity = MIN_RUN_RECORDS;
+    }
+    run_record_t *records = malloc(capacity * sizeof(run_record_t));
+    int *runs = malloc(run_capacity * sizeof(int));
+    if (records == NULL || runs == NULL)
+    {
+        free(records);
+        free(runs);
+        return -1;
+    }
+
+    int result = 0;
+    while (result == 0 && grade_file_next(gf, &cursor, &rec))
+    {
+        fill_grade(&records[count].grade, &rec);
+        records[count++].offset = (uint64_t)(rec.line - gf->data);
+        if (count < capacity)
+        {
+            continue;
+        }
+
+        // The run is full: sort it, move it to disk and let go of the pages it came from
+        sort_run(records, count, compare);
+        int fd = spill_run(records, count);
+        if (fd == -1 || push_run(&runs, &run_count, &run_capacity, fd) == -1)
+        {
+            result = -1;
+            break;
+        }
+        count = 0;
+        grade_file_release(gf, cursor);
+    }
+
+    if (result == 0)
+    {
+        sort_run(records, count, compare);
+        if (run_count == 0)
+        {
+            // Everything fit in memory, no merge needed
+            for (size_t i = 0; i < count && result == 0; i++)
+            {
+                result = put_record(out, &records[i].grade);
+            }
+            free(records);
+            records = NULL;
+        } else
+        {
+            if (count > 0)
+            {
+                int fd = spill_run(records, count);
+                if (fd == -1 || push_run(&runs, &run_count, &run_capacity, fd) == -1)
+                {
+                    result = -1;
+                }
+            }
+            free(records);
+            records = NULL;
+
+            // Split the budget among the read buffers of one merge pass. A budget too small
+            // for MERGE_FAN_IN buffers of SORT_READ_BUFFER bytes merges fewer runs at once
+            // and takes more passes instead of growing past the budget.
+            size_t fan_in = memory_budget / SORT_READ_BUFFER;
+            fan_in = fan_in > MERGE_FAN_IN + 1 ? MERGE_FAN_IN : fan_in > 3 ? fan_in - 1 : 2;
+            size_t buffer_size = memory_budget / (fan_in + 1);
+            if (buffer_size < SORT_READ_BUFFER)
+            {
+                buffer_size = SORT_READ_BUFFER; // only below 3 * SORT_READ_BUFFER, which -m cannot ask for
+            }
+            if (result == 0)
+            {
+                result = reduce_runs(runs, &run_count, fan_in, compare, buffer_size);
+            }
+            if (result == 0)
+            {
+                result = merge_runs(runs, run_count, compare, buffer_size, out);
+                run_count = 0;
+            }
+        }
+    }
+    for (size_t i = 0; i < run_count; i++)
+    {
+        close(runs[i]);
+    }
+    free(records);
+    free(runs);
+    return result;
+}
+
+// The key comparator runs under qsort and in several threads at once; everything it
+// needs is set before the workers start and only read afterwards
+static const grade_file_t *key_file = NULL;
+static SortBy key_by = BY_NAME;
+static int key_sign = 1;
+
+typedef struct {
+    sort_key_t *keys;
+    size_t count;
+    size_t next; // merge cursor
+} sort_partition_t;
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void key_field(const grade_record_t *rec, const char **key, size_t *len)
+{
+    if (key_by == BY_NAME)
+    {
+        *key = rec->name;
+        *len = rec->name_len;
+    } else
+    {
+        *key = rec->grade;
+        *len = rec->grade_len;
+    }
+}
+
+static uint64_t key_prefix(const char *key, size_t len)
+{
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+    {
+        prefix = (prefix << 8) | (i < len ? (unsigned char)key[i] : 0);
+    }
+    return prefix;
+}
+
+// Locate the key of an entry in the mapped file. Names start their line, so only
+// grades and over-long names need the line parsed.
+static void key_bytes(const sort_key_t *entry, const char **key, size_t *len)
+{
+    if (key_by == BY_NAME && entry->length < SORT_KEY_MAX_LENGTH)
+    {
+        *key = key_file->data + entry->offset;
+        *len = entry->length;
+        return;
+    }
+    grade_record_t rec;
+    if (grade_file_record_at(key_file, entry->offset, &rec) == -1)
+    {
+        *key = "";
+        *len = 0;
+        return;
+    }
+    key_field(&rec, key, len);
+}
+
+static int compare_keys(const sort_key_t *a, const sort_key_t *b)
+{
+    int result = 0;
+    if (a->prefix != b->prefix)
+    {
+        result = a->prefix < b->prefix ? -1 : 1;
+    } else if (a->length <= 8 || b->length <= 8)
+    {
+        // Zero padding already decided everything but the length
+        result = (a->length > b->length) - (a->length < b->length);
+    } else
+    {
+        // Both keys continue past the prefix, compare the rest in the file
+        const char *key_a, *key_b;
+        size_t len_a, len_b;
+        key_bytes(a, &key_a, &len_a);
+        key_bytes(b, &key_b, &len_b);
+        size_t n = len_a < len_b ? len_a : len_b;
+        result = memcmp(key_a + 8, key_b + 8, n - 8);
+        if (result == 0)
+        {
+            result = (len_a > len_b) - (len_a < len_b);
+        }
+    }
+    result *= key_sign;
+
+    // Equal keys keep file order
+    if (result == 0)
+    {
+        result = (a->offset > b->offset) - (a->offset < b->offset);
+    }
+    return result;
+}
+
+static int compare_keys_qsort(const void *a, const void *b)
+{
+    return compare_keys(a, b);
+}
+
+static void *sort_partition(void *arg)
+{
+    sort_partition_t *part = arg;
+    qsort(part->keys, part->count, sizeof(sort_key_t), compare_keys_qsort);
+    return NULL;
+}
+
+static int put_key(out_buffer_t *out, const sort_key_t *key)
+{
+    grade_record_t rec;
+    if (grade_file_record_at(key_file, key->offset, &rec) == -1)
+    {
+        return 0;
+    }
+    return put_fields(out, rec.name, rec.name_len, rec.grade, rec.grade_len);
+}
+
+// Collect one key per record. Returns 0 if more than max_keys records exist.
+static int collect_keys(grade_file_t *gf, size_t max_keys, sort_key_t **keys_out, size_t *count_out)
+{
+    size_t capacity = 1024, count = 0, cursor = 0;
+    grade_record_t rec;
+    sort_key_t *keys = malloc(capacity * sizeof(sort_key_t));
+    if (keys == NULL)
+    {
+        return -1;
+    }
+
+    while (grade_file_next(gf, &cursor, &rec))
+    {
+        if (count == max_keys)
+        {
+            free(keys);
+            return 0;
+        }
+        if (count == capacity)
+        {
+            capacity = capacity * 2 < max_keys ? capacity * 2 : max_keys;
+            sort_key_t *grown = realloc(keys, capacity * sizeof(sort_key_t));
+            if (grown == NULL)
+            {
+                free(keys);
+                return -1;
+            }
+            keys = grown;
+        }
+        const char *key;
+        size_t len;
+        key_field(&rec, &key, &len);
+        keys[count].prefix = key_prefix(key, len);
+        keys[count].offset = (uint64_t)(rec.line - gf->data);
+        keys[count].length = len < SORT_KEY_MAX_LENGTH ? len : SORT_KEY_MAX_LENGTH;
+        count++;
+    }
+
+    *keys_out = keys;
+    *count_out = count;
+    return 1;
+}
+
+// Sort the keys in `threads` contiguous partitions, each on its own thread
+static int sort_keys_parallel(sort_key_t *keys, size_t count, sort_partition_t *parts, int threads)
+{
+    pthread_t workers[MAX_SORT_THREADS];
+    size_t first = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        size_t size = count / threads + ((size_t)i < count % threads);
+        parts[i].keys = keys + first;
+        parts[i].count = size;
+        parts[i].next = 0;
+        first += size;
+    }
+    if (threads == 1)
+    {
+        sort_partition(&parts[0]);
+        return 0;
+    }
+
+    int started = 0, result = 0;
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&workers[started], NULL, sort_partition, &parts[started]) != 0)
+        {
+            result = -1;
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    return result;
+}
+
+static int partition_less(const sort_partition_t *a, const sort_partition_t *b)
+{
+    return compare_keys(&a->keys[a->next], &b->keys[b->next]) < 0;
+}
+
+static void partition_sift_down(sort_partition_t **heap, int count, int i)
+{
+    while (1)
+    {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && partition_less(heap[left], heap[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < count && partition_less(heap[right], heap[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == i)
+        {
+            return;
+        }
+        sort_partition_t *tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Merge the sorted partitions straight into the output with a min-heap of partition heads.
+// The offsets of the records are also collected in output order when order is not NULL.
+static int merge_partitions(sort_partition_t *parts, int threads, out_buffer_t *out, uint64_t *order)
+{
+    sort_partition_t *heap[MAX_SORT_THREADS];
+    int heap_count = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (parts[i].count > 0)
+        {
+            heap[heap_count++] = &parts[i];
+        }
+    }
+    for (int i = heap_count / 2 - 1; i >= 0; i--)
+    {
+        partition_sift_down(heap, heap_count, i);
+    }
+
+    while (heap_count > 0)
+    {
+        sort_partition_t *top = heap[0];
+        if (put_key(out, &top->keys[top->next]) == -1)
+        {
+            return -1;
+        }
+        if (order != NULL)
+        {
+            *order++ = top->keys[top->next].offset;
+        }
+        if (++top->next == top->count)
+        {
+            heap[0] = heap[--heap_count];
+        }
+        partition_sift_down(heap, heap_count, 0);
+    }
+    return 0;
+}
+
+// The previous in-memory path: whole StudentGrade structs sorted by one qsort.
+// Only run for the speedup report. Returns the time taken, or -1 if it does not fit the budget.
+static double time_struct_sort(grade_file_t *gf, compare_fn compare, size_t count, size_t memory_budget)
+{
+    struct timespec start;
+    grade_record_t rec;
+    size_t cursor = 0, filled = 0;
+
+    if (count * sizeof(StudentGrade) > memory_budget)
+    {
+        return -1;
+    }
+    StudentGrade *records = malloc((count > 0 ? count : 1) * sizeof(StudentGrade));
+    if (records == NULL)
+    {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (filled < count && grade_file_next(gf, &cursor, &rec))
+    {
+        fill_grade(&records[filled++], &rec);
+    }
+    qsort(records, filled, sizeof(StudentGrade), compare);
+    double ms = elapsed_ms(&start);
+    free(records);
+    return ms;
+}
+
+static int print_report(out_buffer_t *out, size_t count, int threads, double parallel_ms, double baseline_ms)
+{
+    char message[256];
+    int len;
+    if (baseline_ms < 0)
+    {
+        len = snprintf(message, sizeof(message),
+                       "Sorted %zu records with %d thread(s) in %.2f ms (single-threaded StudentGrade sort skipped: over the memory budget)\n",
+                       count, threads, parallel_ms);
+    } else
+    {
+        len = snprintf(message, sizeof(message),
+                       "Sorted %zu records with %d thread(s) in %.2f ms, single-threaded StudentGrade sort took %.2f ms (speedup %.2fx)\n",
+                       count, threads, parallel_ms, baseline_ms, parallel_ms > 0 ? baseline_ms / parallel_ms : 0.0);
+    }
+    return out_write(out, message, (size_t)len);
+}
+
+// Grade then name, for grade sorts that must keep name order but cannot use the counting sort
+static int compare_grade_then_name(const void *a, const void *b)
+{
+    const StudentGrade *gradeA = a;
+    const StudentGrade *gradeB = b;
+    int result = strcmp(gradeA->grade, gradeB->grade);
+    return result != 0 ? result : strcmp(gradeA->name, gradeB->name);
+}
+
+static int compare_grade_desc_then_name(const void *a, const void *b)
+{
+    const StudentGrade *gradeA = a;
+    const StudentGrade *gradeB = b;
+    int result = strcmp(gradeB->grade, gradeA->grade);
+    return result != 0 ? result : strcmp(gradeA->name, gradeB->name);
+}
+
+// Bucket of a grade of at most two bytes; the zero padding keeps strcmp order
+static unsigned grade_bucket(const grade_record_t *rec)
+{
+    unsigned first = (unsigned char)rec->grade[0];
+    unsigned second = rec->grade_len > 1 ? (unsigned char)rec->grade[1] : 0;
+    return (first << 8) | second;
+}
+
+// Next record of a counting sort pass: from the name-ordered offsets when there are
+// some, otherwise straight from the file
+static int next_source_record(grade_file_t *gf, const uint64_t *order, uint64_t count, uint64_t *i, size_t *cursor, grade_record_t *rec)
+{
+    if (order == NULL)
+    {
+        return grade_file_next(gf, cursor, rec);
+    }
+    while (*i < count)
+    {
+        if (grade_file_record_at(gf, (size_t)order[(*i)++], rec) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Linear-time sort by grade: count the records of each grade, turn the counts into
+// bucket positions and drop every record into place. Records of the same grade keep
+// the order they are read in, which is name order when options->nameOrder is set.
+// Returns 0 when the data does not suit it (long grades, over the budget).
+static int counting_sort_grades(grade_file_t *gf, const char *filename, const SortOptions *options, out_buffer_t *out)
+{
+    name_index_t ni;
+    const uint64_t *order = NULL;
+    uint64_t order_count = 0, i = 0;
+    uint64_t total = 0;
+    size_t cursor = 0;
+    grade_record_t rec;
+    int result = 0;
+
+    uint64_t *buckets = calloc(GRADE_BUCKETS, sizeof(uint64_t));
+    if (buckets == NULL)
+    {
+        return -1;
+    }
+    // Name order is read straight from the mapped index. Opening it may build or merge the
+    // index in memory, so the expected size is checked against the budget first.
+    ni.map = NULL;
+    if (options->nameOrder)
+    {
+        if (name_index_expected_count(filename, gf) * sizeof(uint64_t) > options->memoryBudget ||
+            name_index_open_sorted(&ni, filename, gf) == -1 || ni.header.sorted_count * sizeof(uint64_t) > options->memoryBudget)
+        {
+            name_index_close(&ni);
+            free(buckets);
+            return 0;
+        }
+        order = ni.entries;
+        order_count = ni.header.sorted_count;
+    }
+
+    // Counting pass
+    while (next_source_record(gf, order, order_count, &i, &cursor, &rec))
+    {
+        if (rec.grade_len > 2)
+        {
+            free(buckets);
+            name_index_close(&ni);
+            return 0;
+        }
+        buckets[grade_bucket(&rec)]++;
+        total++;
+    }
+    if ((total + order_count) * sizeof(uint64_t) > options->memoryBudget)
+    {
+        free(buckets);
+        name_index_close(&ni);
+        return 0;
+    }
+
+    // Bucket start positions, walking the grades in the requested direction
+    uint64_t position = 0;
+    for (unsigned b = 0; b < GRADE_BUCKETS; b++)
+    {
+        unsigned bucket = options->sortOrder == ASCENDING ? b : GRADE_BUCKETS - 1 - b;
+        uint64_t bucket_count = buckets[bucket];
+        buckets[bucket] = position;
+        position += bucket_count;
+    }
+
+    // Placement pass
+    uint64_t *sorted = malloc((total > 0 ? total : 1) * sizeof(uint64_t));
+    if (sorted == NULL)
+    {
+        free(buckets);
+        name_index_close(&ni);
+        return -1;
+    }
+    i = 0;
+    cursor = 0;
+    while (next_source_record(gf, order, order_count, &i, &cursor, &rec))
+    {
+        sorted[buckets[grade_bucket(&rec)]++] = (uint64_t)(rec.line - gf->data);
+    }
+    free(buckets);
+    name_index_close(&ni);
+
+    for (uint64_t k = 0; k < total && result == 0; k++)
+    {
+        if (grade_file_record_at(gf, (size_t)sorted[k], &rec) == 0)
+        {
+            result = put_fields(out, rec.name, rec.name_len, rec.grade, rec.grade_len);
+        }
+    }
+    free(sorted);
+    return result == 0 ? 1 : -1;
+}
+
+static int same_name(const grade_file_t *gf, uint64_t a, uint64_t b)
+{
+    grade_record_t rec_a, rec_b;
+    return grade_file_record_at(gf, (size_t)a, &rec_a) == 0 && grade_file_record_at(gf, (size_t)b, &rec_b) == 0 &&
+           compare_names(rec_a.name, rec_a.name_len, rec_b.name, rec_b.name_len) == 0;
+}
+
+static int put_offset(out_buffer_t *out, const grade_file_t *gf, uint64_t offset)
+{
+    grade_record_t rec;
+    if (grade_file_record_at(gf, (size_t)offset, &rec) == -1)
+    {
+        return 0;
+    }
+    return put_fields(out, rec.name, rec.name_len, rec.grade, rec.grade_len);
+}
+
+// Reverse every run of equal names in place
+static void reverse_ties(const grade_file_t *gf, uint64_t *offsets, uint64_t count)
+{
+    uint64_t start = 0;
+    while (start < count)
+    {
+        uint64_t end = start + 1;
+        while (end < count && same_name(gf, offsets[start], offsets[end]))
+        {
+            end++;
+        }
+        for (uint64_t i = start, j = end - 1; i < j; i++, j--)
+        {
+            uint64_t tmp = offsets[i];
+            offsets[i] = offsets[j];
+            offsets[j] = tmp;
+        }
+        start = end;
+    }
+}
+
+// Name sorts are served from the name index: a sorted run persisted on disk plus the
+// records appended since, which name_index_open_sorted sorts and merges in. Sorting a
+// file that gained k records since the last sort costs O(n + k log k) instead of
+// O(n log n). Returns 0 when the file has no index yet or its offsets do not fit the memory budget.
+static int sort_from_index(grade_file_t *gf, const char *filename, const SortOptions *options, out_buffer_t *out)
+{
+    char path[512];
+    name_index_t ni;
+    int result = 0;
+
+    // Offsets over the budget leave the sort to the key or external sort, which keep to it
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+    if (access(path, F_OK) == -1 || name_index_expected_count(filename, gf) * sizeof(uint64_t) > options->memoryBudget ||
+        name_index_open_sorted(&ni, filename, gf) == -1)
+    {
+        return 0;
+    }
+
+    uint64_t count = ni.header.sorted_count;
+    if (options->sortOrder == ASCENDING)
+    {
+        for (uint64_t i = 0; i < count && result == 0; i++)
+        {
+            result = put_offset(out, gf, ni.entries[i]);
+        }
+    } else
+    {
+        // Back to front one group of equal names at a time, each group in file order as the sort keeps it
+        uint64_t end = count;
+        while (end > 0 && result == 0)
+        {
+            uint64_t start = end - 1;
+            while (start > 0 && same_name(gf, ni.entries[start - 1], ni.entries[start]))
+            {
+                start--;
+            }
+            for (uint64_t i = start; i < end && result == 0; i++)
+            {
+                result = put_offset(out, gf, ni.entries[i]);
+            }
+            end = start;
+        }
+    }
+    name_index_close(&ni);
+    return result == 0 ? 1 : -1;
+}
+
+// Keep the result of a full name sort as the name index, so the next sort of the same
+// file can start from it
+static void save_name_order(grade_file_t *gf, const char *filename, SortOrder sort_order, uint64_t *order, size_t count)
+{
+    // (name descending, file order) reversed is (name ascending, reverse file order)
+    if (sort_order == DESCENDING)
+    {
+        for (size_t i = 0, j = count > 0 ? count - 1 : 0; i < j; i++, j--)
+        {
+            uint64_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+        reverse_ties(gf, order, count);
+    }
+    name_index_write(filename, gf->fd, order, count, gf->size); // only a cache: on failure the next sort sorts again
+}
+
+// External sort of gf, timed for -r against the single-threaded StudentGrade sort
+static int report_external_sort(grade_file_t *gf, compare_fn compare, const SortOptions *options, out_buffer_t *out)
+{
+    struct timespec start;
+    grade_record_t rec;
+    size_t cursor = 0, count = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = external_sort(gf, compare, options->memoryBudget, out);
+    if (result == -1 || !options->report)
+    {
+        return result;
+    }
+    double external_ms = elapsed_ms(&start);
+    while (grade_file_next(gf, &cursor, &rec))
+    {
+        count++;
+    }
+    return print_report(out, count, 1, external_ms, time_struct_sort(gf, compare, count, options->memoryBudget));
+}
+
+// Sort every record of gf and queue it on out. Grade sorts use the counting sort
+// when they can. Otherwise, when the keys fit in the memory budget
+// they are sorted in memory on options->threads threads; otherwise the records go
+// through external_sort with compare.
+int sort_grades(grade_file_t *gf, const char *filename, const SortOptions *options, compare_fn compare, out_buffer_t *out)
+{
+    sort_partition_t parts[MAX_SORT_THREADS];
+    struct timespec start;
+    sort_key_t *keys = NULL;
+    size_t count = 0;
+    int threads = options->threads < 1 ? 1 : options->threads > MAX_SORT_THREADS ? MAX_SORT_THREADS : options->threads;
+
+    if (options->sortBy == BY_GRADE)
+    {
+        // The report times the key sort, so -r takes that path even when counting would do
+        int counted = options->report ? 0 : counting_sort_grades(gf, filename, options, out);
+        if (counted != 0)
+        {
+            return counted == 1 ? 0 : -1;
+        }
+        if (options->nameOrder)
+        {
+            compare = options->sortOrder == ASCENDING ? compare_grade_then_name : compare_grade_desc_then_name;
+            return report_external_sort(gf, compare, options, out);
+        }
+    }
+
+    if (options->sortBy == BY_NAME && !options->report)
+    {
+        int indexed = sort_from_index(gf, filename, options, out);
+        if (indexed != 0)
+        {
+            return indexed == 1 ? 0 : -1;
+        }
+    }
+
+    key_file = gf;
+    key_by = options->sortBy;
+    key_sign = options->sortOrder == ASCENDING ? 1 : -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fits = collect_keys(gf, options->memoryBudget / sizeof(sort_key_t), &keys, &count);
+    if (fits == -1)
+    {
+        return -1;
+    }
+    if (fits == 0)
+    {
+        return report_external_sort(gf, compare, options, out);
+    }
+
+    if (sort_keys_parallel(keys, count, parts, threads) == -1)
+    {
+        free(keys);
+        return -1;
+    }
+    double parallel_ms = elapsed_ms(&start);
+
+    // A name sort that had no index to start from leaves one behind
+    uint64_t *order = NULL;
+    if (options->sortBy == BY_NAME && !options->report)
+    {
+        order = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    }
+    int result = merge_partitions(parts, threads, out, order);
+    free(keys);
+    if (result == 0 && order != NULL)
+    {
+        save_name_order(gf, filename, options->sortOrder, order, count);
+    }
+    free(order);
+
+    if (result == 0 && options->report)
+    {
+        result = print_report(out, count, threads, parallel_ms, time_struct_sort(gf, compare, count, options->memoryBudget));
+    }
+    return result;
+}
+
+// Sort entry of a binary store: the first 16 name bytes as two integers plus the record
+// number, so that most comparisons never touch the records
+typedef struct {
+    uint64_t prefix[2];
+    uint64_t index;
+} store_key_t;
+
+// qsort has no context argument, so the store being sorted is kept here
+static const grade_store_t *key_store = NULL;
+
+static int compare_store_keys(const void *a, const void *b)
+{
+    const store_key_t *key_a = a;
+    const store_key_t *key_b = b;
+    int result = 0;
+    if (key_a->prefix[0] != key_b->prefix[0])
+    {
+        result = key_a->prefix[0] < key_b->prefix[0] ? -1 : 1;
+    } else if (key_a->prefix[1] != key_b->prefix[1])
+    {
+        result = key_a->prefix[1] < key_b->prefix[1] ? -1 : 1;
+    } else if ((key_a->prefix[1] & 0xff) != 0)
+    {
+        // Names are NUL-padded to the same width, so memcmp orders them like strcmp
+        result = memcmp(key_store->records[key_a->index].name + 16, key_store->records[key_b->index].name + 16,
+                        sizeof(key_store->records->name) - 16);
+    }
+    result *= key_sign;
+    return result != 0 ? result : (key_a->index > key_b->index) - (key_a->index < key_b->index);
+}
+
+// Record numbers of gs in name order, equal names in record order. The caller frees the array.
+static uint64_t *store_name_order(const grade_store_t *gs, int sign)
+{
+    store_key_t *keys = malloc((gs->count > 0 ? gs->count : 1) * sizeof(store_key_t));
+    if (keys == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < gs->count; i++)
+    {
+        keys[i].prefix[0] = key_prefix(gs->records[i].name, 8);
+        keys[i].prefix[1] = key_prefix(gs->records[i].name + 8, 8);
+        keys[i].index = i;
+    }
+    key_store = gs;
+    key_sign = sign;
+    qsort(keys, gs->count, sizeof(store_key_t), compare_store_keys);
+
+    // Reuse the key array for the record numbers
+    uint64_t *order = (uint64_t *)keys; // each key is wider than the number it turns into
+    for (uint64_t i = 0; i < gs->count; i++)
+    {
+        order[i] = keys[i].index;
+    }
+    return order;
+}
+
+// Sort a binary store. Name sorts order 24-byte keys pointing at the mapped records;
+// grade sorts are a counting sort over the interned grade codes. Unlike sort_grades this
+// ignores memoryBudget and threads: the keys are a quarter of the mapped records in size.
+int sort_store(const grade_store_t *gs, const SortOptions *options, out_buffer_t *out)
+{
+    int result = 0;
+
+    if (options->sortBy == BY_NAME)
+    {
+        uint64_t *order = store_name_order(gs, options->sortOrder == ASCENDING ? 1 : -1);
+        if (order == NULL)
+        {
+            return -1;
+        }
+        for (uint64_t i = 0; i < gs->count && result == 0; i++)
+        {
+            result = grade_store_put(gs, order[i], 1, out);
+        }
+        free(order);
+        return result;
+    }
+
+    // Rank the interned grades so that the counting sort follows strcmp order
+    uint32_t grade_count = gs->header->grade_count;
+    uint8_t by_rank[GRADE_CODES];
+    uint64_t start[GRADE_CODES] = { 0 };
+    for (uint32_t g = 0; g < grade_count; g++)
+    {
+        by_rank[g] = (uint8_t)g;
+    }
+    for (uint32_t g = 1; g < grade_count; g++)
+    {
+        uint8_t code = by_rank[g];
+        uint32_t k = g;
+        while (k > 0 && strcmp(gs->header->grades[by_rank[k - 1]], gs->header->grades[code]) > 0)
+        {
+            by_rank[k] = by_rank[k - 1];
+            k--;
+        }
+        by_rank[k] = code;
+    }
+
+    uint64_t *order = options->nameOrder ? store_name_order(gs, 1) : NULL;
+    uint64_t *sorted = malloc((gs->count > 0 ? gs->count : 1) * sizeof(uint64_t));
+    if (sorted == NULL || (options->nameOrder && order == NULL))
+    {
+        free(order);
+        free(sorted);
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < gs->count; i++)
+    {
+        if (gs->records[i].grade >= grade_count)
+        {
+            // A code with no bucket would place the record outside sorted
+            free(order);
+            free(sorted);
+            errno = EINVAL;
+            return -1;
+        }
+        start[gs->records[i].grade]++;
+    }
+    uint64_t position = 0;
+    for (uint32_t g = 0; g < grade_count; g++)
+    {
+        uint8_t code = by_rank[options->sortOrder == ASCENDING ? g : grade_count - 1 - g];
+        uint64_t bucket_count = start[code];
+        start[code] = position;
+        position += bucket_count;
+    }
+    for (uint64_t i = 0; i < gs->count; i++)
+    {
+        uint64_t record = order != NULL ? order[i] : i;
+        sorted[start[gs->records[record].grade]++] = record;
+    }
+    free(order);
+
+    for (uint64_t i = 0; i < gs->count && result == 0; i++)
+    {
+        result = grade_store_put(gs, sorted[i], 1, out);
+    }
+    free(sorted);
+    return result;
+}
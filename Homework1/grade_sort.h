@@ -0,0 +1,31 @@
+#ifndef GRADE_SORT_H
+#define GRADE_SORT_H
+
+#include <stdint.h>
+#include "common.h"
+#include "grade_file.h"
+#include "grade_store.h"
+#include "out_buffer.h"
+
+#define MERGE_FAN_IN 64      // runs merged at once; more runs are merged in several passes
+#define MIN_RUN_RECORDS 16
+#define SORT_READ_BUFFER (64 * 1024) // smallest read buffer of a run during the merge
+#define GRADE_BUCKETS 65536  // one counting sort bucket per possible two-byte grade
+
+typedef int (*compare_fn)(const void *, const void *);
+
+#define SORT_KEY_MAX_LENGTH 0xFFFF
+
+// Compact sort entry: the first 8 key bytes packed so that integer order is byte
+// order, plus where the record sits in the mapped file and how long its key is
+typedef struct {
+    uint64_t prefix;
+    uint64_t offset : 48;
+    uint64_t length : 16; // clamped to SORT_KEY_MAX_LENGTH
+} sort_key_t;
+
+int external_sort(grade_file_t *gf, compare_fn compare, size_t memory_budget, out_buffer_t *out);
+int sort_grades(grade_file_t *gf, const char *filename, const SortOptions *options, compare_fn compare, out_buffer_t *out);
+int sort_store(const grade_store_t *gs, const SortOptions *options, out_buffer_t *out);
+
+#endif
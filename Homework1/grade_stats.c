@@ -0,0 +1,215 @@
+#include "grade_stats.h"
+#include "grade_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_BUCKETS 65536 // one counter per possible two-byte grade
+
+// Letter grades and their grade points, for the average
+static const struct {
+    const char *grade;
+    double points;
+} grade_points[] = {
+    { "AA", 4.0 }, { "BA", 3.5 }, { "BB", 3.0 }, { "CB", 2.5 },
+    { "CC", 2.0 }, { "DC", 1.5 }, { "DD", 1.0 }, { "FF", 0.0 },
+};
+
+// Bounded max-heap holding the best top_k entries seen so far; the root is the worst of them
+typedef struct {
+    stats_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} top_heap_t;
+
+// Lower grades are better grades; equal grades keep file order
+static int compare_entries(const stats_entry_t *a, const stats_entry_t *b)
+{
+    int result = strcmp(a->grade, b->grade);
+    return result != 0 ? result : (a->position > b->position) - (a->position < b->position);
+}
+
+static int compare_entries_qsort(const void *a, const void *b)
+{
+    return compare_entries(a, b);
+}
+
+static void heap_sift_up(top_heap_t *heap, size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (compare_entries(&heap->entries[parent], &heap->entries[i]) >= 0)
+        {
+            break;
+        }
+        stats_entry_t tmp = heap->entries[parent];
+        heap->entries[parent] = heap->entries[i];
+        heap->entries[i] = tmp;
+        i = parent;
+    }
+}
+
+static void heap_sift_down(top_heap_t *heap, size_t i)
+{
+    while (1)
+    {
+        size_t worst = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < heap->count && compare_entries(&heap->entries[left], &heap->entries[worst]) > 0)
+        {
+            worst = left;
+        }
+        if (right < heap->count && compare_entries(&heap->entries[right], &heap->entries[worst]) > 0)
+        {
+            worst = right;
+        }
+        if (worst == i)
+        {
+            return;
+        }
+        stats_entry_t tmp = heap->entries[worst];
+        heap->entries[worst] = heap->entries[i];
+        heap->entries[i] = tmp;
+        i = worst;
+    }
+}
+
+// O(log K) per record that makes it into the top K, O(1) for every other record
+static void heap_offer(top_heap_t *heap, const char *grade, size_t grade_len, uint64_t position)
+{
+    stats_entry_t entry;
+    memset(entry.grade, 0, sizeof(entry.grade));
+    memcpy(entry.grade, grade, grade_len);
+    entry.position = position;
+
+    if (heap->count < heap->capacity)
+    {
+        heap->entries[heap->count++] = entry;
+        heap_sift_up(heap, heap->count - 1);
+    } else if (heap->capacity > 0 && compare_entries(&entry, &heap->entries[0]) < 0)
+    {
+        heap->entries[0] = entry;
+        heap_sift_down(heap, 0);
+    }
+}
+
+static unsigned bucket_of(const char *grade, size_t len)
+{
+    return ((unsigned)(unsigned char)grade[0] << 8) | (len > 1 ? (unsigned char)grade[1] : 0);
+}
+
+static int put_text(out_buffer_t *out, const char *text)
+{
+    return out_write(out, text, strlen(text));
+}
+
+// Histogram, totals, average grade point and the top_k students of gf in a single pass.
+// Memory is one counter per possible two-byte grade plus top_k heap entries; the file is
+// never copied or sorted.
+int grade_stats(const grade_file_t *gf, size_t top_k, out_buffer_t *out)
+{
+    top_heap_t heap = { .capacity = top_k };
+    uint64_t total = 0, other = 0;
+    grade_store_t store;
+    char line[128];
+    int result = 0;
+
+    uint64_t *counts = calloc(STATS_BUCKETS, sizeof(uint64_t));
+    heap.entries = malloc((top_k > 0 ? top_k : 1) * sizeof(stats_entry_t));
+    if (counts == NULL || heap.entries == NULL)
+    {
+        free(counts);
+        free(heap.entries);
+        return -1;
+    }
+
+    int binary = grade_store_attach(&store, gf) == 0;
+    if (binary)
+    {
+        for (uint64_t i = 0; i < store.count; i++)
+        {
+            const char *grade = grade_store_grade(&store, &store.records[i]);
+            if (grade == NULL)
+            {
+                other++; // a damaged record, counted like an unparseable text line
+                continue;
+            }
+            size_t len = strlen(grade);
+            counts[bucket_of(grade, len)]++;
+            heap_offer(&heap, grade, len, i);
+        }
+        total = store.count;
+    } else
+    {
+        grade_record_t rec;
+        size_t cursor = 0;
+        while (grade_file_next(gf, &cursor, &rec))
+        {
+            total++;
+            if (rec.grade_len == 0 || rec.grade_len > 2)
+            {
+                other++;
+                continue;
+            }
+            counts[bucket_of(rec.grade, rec.grade_len)]++;
+            heap_offer(&heap, rec.grade, rec.grade_len, (uint64_t)(rec.line - gf->data));
+        }
+    }
+
+    snprintf(line, sizeof(line), "Total records: %llu\n", (unsigned long long)total);
+    result |= put_text(out, line);
+
+    double points = 0;
+    uint64_t graded = 0;
+    for (unsigned b = 0; b < STATS_BUCKETS; b++)
+    {
+        if (counts[b] == 0)
+        {
+            continue;
+        }
+        char grade[3] = { (char)(b >> 8), (char)(b & 0xff), '\0' };
+        snprintf(line, sizeof(line), "%s: %llu (%.2f%%)\n", grade, (unsigned long long)counts[b], 100.0 * counts[b] / total);
+        result |= put_text(out, line);
+        for (size_t g = 0; g < sizeof(grade_points) / sizeof(grade_points[0]); g++)
+        {
+            if (strcmp(grade, grade_points[g].grade) == 0)
+            {
+                points += grade_points[g].points * counts[b];
+                graded += counts[b];
+            }
+        }
+    }
+    if (other > 0)
+    {
+        snprintf(line, sizeof(line), "Other grades: %llu\n", (unsigned long long)other);
+        result |= put_text(out, line);
+    }
+    if (graded > 0)
+    {
+        snprintf(line, sizeof(line), "Average grade point: %.2f over %llu letter grades\n", points / graded, (unsigned long long)graded);
+        result |= put_text(out, line);
+    }
+
+    if (top_k > 0 && heap.count > 0)
+    {
+        snprintf(line, sizeof(line), "Top %zu students:\n", heap.count);
+        result |= put_text(out, line);
+        qsort(heap.entries, heap.count, sizeof(stats_entry_t), compare_entries_qsort);
+        for (size_t i = 0; i < heap.count && result == 0; i++)
+        {
+            grade_record_t rec;
+            if (binary)
+            {
+                result = grade_store_put(&store, heap.entries[i].position, 1, out);
+            } else if (grade_file_record_at(gf, (size_t)heap.entries[i].position, &rec) == 0)
+            {
+                result = out_write(out, rec.line, rec.line_len) == -1 || out_write(out, "\n", 1) == -1 ? -1 : 0;
+            }
+        }
+    }
+
+    free(counts);
+    free(heap.entries);
+    return result == 0 ? 0 : -1;
+}
@@ -0,0 +1,21 @@
+#ifndef GRADE_STATS_H
+#define GRADE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "grade_file.h"
+#include "out_buffer.h"
+
+#define STATS_DEFAULT_TOP 10
+#define STATS_MAX_TOP 1000000
+
+// Top-K candidate: its grade plus where the record is (byte offset in a text file,
+// record number in a binary store), which also breaks ties in file order
+typedef struct {
+    char grade[3];
+    uint64_t position;
+} stats_entry_t;
+
+int grade_stats(const grade_file_t *gf, size_t top_k, out_buffer_t *out);
+
+#endif
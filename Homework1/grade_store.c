@@ -0,0 +1,230 @@
+#include "grade_store.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STORE_VERSION 1
+#define STORE_WRITE_RECORDS 1024 // records buffered per write while converting
+
+// True when fd starts with the binary store magic
+int grade_store_probe(int fd)
+{
+    char magic[4];
+    return pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+           memcmp(magic, GRADE_STORE_MAGIC, sizeof(magic)) == 0;
+}
+
+// Returns -1 when the mapping is a text file or a damaged store; a damaged header sets
+// errno to EINVAL. Only the header is checked, so attaching stays O(1): record grade codes
+// are checked against the grade table where they are used.
+int grade_store_attach(grade_store_t *gs, const grade_file_t *gf)
+{
+    if (gf->data == NULL || gf->size < GRADE_STORE_DATA_OFFSET ||
+        memcmp(gf->data, GRADE_STORE_MAGIC, 4) != 0)
+    {
+        return -1;
+    }
+
+    const grade_store_header_t *header = (const grade_store_header_t *)gf->data;
+    if (header->version != STORE_VERSION || header->record_size != sizeof(grade_store_record_t) ||
+        header->grade_count > GRADE_CODES ||
+        header->record_count > (gf->size - GRADE_STORE_DATA_OFFSET) / sizeof(grade_store_record_t))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    gs->header = header;
+    gs->records = (const grade_store_record_t *)(gf->data + GRADE_STORE_DATA_OFFSET);
+    gs->count = header->record_count;
+    return 0;
+}
+
+// Grade of rec, or NULL when its code has no entry in the grade table
+const char *grade_store_grade(const grade_store_t *gs, const grade_store_record_t *rec)
+{
+    return rec->grade < gs->header->grade_count ? gs->header->grades[rec->grade] : NULL;
+}
+
+// Print records first .. first + count - 1 as "name grade" lines. Fails with EINVAL at the
+// first record whose grade code is not in the grade table.
+int grade_store_put(const grade_store_t *gs, uint64_t first, uint64_t count, out_buffer_t *out)
+{
+    uint64_t last = first + count < gs->count && first + count > first ? first + count : gs->count;
+    for (uint64_t i = first; i < last; i++)
+    {
+        const grade_store_record_t *rec = &gs->records[i];
+        const char *grade = grade_store_grade(gs, rec);
+        if (grade == NULL)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (out_write(out, rec->name, strnlen(rec->name, sizeof(rec->name))) == -1 || out_write(out, " ", 1) == -1 ||
+            out_write(out, grade, strlen(grade)) == -1 || out_write(out, "\n", 1) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_at(int fd, const void *data, size_t len, off_t offset)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t written = pwrite(fd, p, len, offset);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        len -= (size_t)written;
+        offset += written;
+    }
+    return 0;
+}
+
+// Convert every record of a text grades file. Names that do not fit StudentGrade.name and
+// grades longer than two bytes are skipped and counted. The store is written to a
+// temporary file and renamed over path, so readers never see half a conversion.
+int grade_store_from_text(const grade_file_t *text, const char *path, uint64_t *written, uint64_t *skipped)
+{
+    char tmp_path[512];
+    grade_store_header_t header;
+    grade_record_t rec;
+    size_t cursor = 0;
+    size_t batched = 0;
+    int result = 0;
+
+    grade_store_record_t *batch = malloc(STORE_WRITE_RECORDS * sizeof(grade_store_record_t));
+    int16_t *codes = malloc(65536 * sizeof(int16_t)); // two-byte grade -> interned code
+    if (batch == NULL || codes == NULL)
+    {
+        free(batch);
+        free(codes);
+        return -1;
+    }
+    memset(codes, 0xff, 65536 * sizeof(int16_t));
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRADE_STORE_MAGIC, sizeof(header.magic));
+    header.version = STORE_VERSION;
+    header.record_size = sizeof(grade_store_record_t);
+
+    int fd = grade_file_create_temp(path, tmp_path, sizeof(tmp_path));
+    if (fd == -1)
+    {
+        free(batch);
+        free(codes);
+        return -1;
+    }
+
+    *skipped = 0;
+    while (result == 0 && grade_file_next(text, &cursor, &rec))
+    {
+        if (rec.name_len >= sizeof(batch->name) || rec.grade_len > 2)
+        {
+            (*skipped)++;
+            continue;
+        }
+        unsigned key = ((unsigned)(unsigned char)rec.grade[0] << 8) | (rec.grade_len > 1 ? (unsigned char)rec.grade[1] : 0);
+        if (codes[key] == -1)
+        {
+            if (header.grade_count == GRADE_CODES)
+            {
+                errno = EOVERFLOW;
+                result = -1;
+                break;
+            }
+            memcpy(header.grades[header.grade_count], rec.grade, rec.grade_len);
+            codes[key] = (int16_t)header.grade_count++;
+        }
+
+        grade_store_record_t *out = &batch[batched++];
+        memset(out, 0, sizeof(*out));
+        memcpy(out->name, rec.name, rec.name_len);
+        out->grade = (uint8_t)codes[key];
+        if (batched == STORE_WRITE_RECORDS)
+        {
+            result = write_at(fd, batch, batched * sizeof(*batch),
+                              GRADE_STORE_DATA_OFFSET + header.record_count * sizeof(*batch));
+            header.record_count += batched;
+            batched = 0;
+        }
+    }
+    if (result == 0 && batched > 0)
+    {
+        result = write_at(fd, batch, batched * sizeof(*batch), GRADE_STORE_DATA_OFFSET + header.record_count * sizeof(*batch));
+        header.record_count += batched;
+    }
+
+    // The header goes last and the file is sized explicitly, so an empty store still
+    // has its full header page
+    if (result == 0)
+    {
+        result = write_at(fd, &header, sizeof(header), 0);
+    }
+    if (result == 0)
+    {
+        result = ftruncate(fd, GRADE_STORE_DATA_OFFSET + header.record_count * sizeof(grade_store_record_t));
+    }
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    if (result == 0)
+    {
+        result = rename(tmp_path, path);
+    }
+    if (result == -1)
+    {
+        unlink(tmp_path);
+    }
+    *written = header.record_count;
+    free(batch);
+    free(codes);
+    return result;
+}
+
+int grade_store_to_text(const grade_store_t *gs, const char *path)
+{
+    char tmp_path[512];
+    out_buffer_t *out = malloc(sizeof(out_buffer_t));
+    if (out == NULL)
+    {
+        return -1;
+    }
+    int fd = grade_file_create_temp(path, tmp_path, sizeof(tmp_path));
+    if (fd == -1)
+    {
+        free(out);
+        return -1;
+    }
+    out_init(out, fd);
+
+    int result = grade_store_put(gs, 0, gs->count, out);
+    if (result == 0)
+    {
+        result = out_flush(out);
+    }
+    if (close(fd) == -1)
+    {
+        result = -1;
+    }
+    if (result == 0)
+    {
+        result = rename(tmp_path, path);
+    }
+    if (result == -1)
+    {
+        unlink(tmp_path);
+    }
+    free(out);
+    return result;
+}
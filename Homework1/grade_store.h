@@ -0,0 +1,44 @@
+#ifndef GRADE_STORE_H
+#define GRADE_STORE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "grade_file.h"
+#include "out_buffer.h"
+
+#define GRADE_STORE_MAGIC "GBIN"
+#define GRADE_STORE_DATA_OFFSET 4096 // records start on a page boundary after the header
+#define GRADE_CODES 256              // distinct grades one store can intern
+
+// Fixed-width record. name has the size and NUL padding of StudentGrade.name, so record i
+// sits at GRADE_STORE_DATA_OFFSET + i * sizeof(grade_store_record_t) and names compare with memcmp.
+typedef struct {
+    char name[sizeof(((StudentGrade *)0)->name)];
+    uint8_t grade;       // index into the grade table of the header
+    uint8_t reserved[3]; // keeps records 8-byte aligned
+} grade_store_record_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t grade_count;
+    uint64_t record_count;
+    char grades[GRADE_CODES][sizeof(((StudentGrade *)0)->grade)]; // interned grades, NUL-terminated
+} grade_store_header_t;
+
+// View of a mapped grade_file_t that holds a binary store
+typedef struct {
+    const grade_store_header_t *header;
+    const grade_store_record_t *records;
+    uint64_t count;
+} grade_store_t;
+
+int grade_store_probe(int fd);
+int grade_store_attach(grade_store_t *gs, const grade_file_t *gf);
+const char *grade_store_grade(const grade_store_t *gs, const grade_store_record_t *rec);
+int grade_store_put(const grade_store_t *gs, uint64_t first, uint64_t count, out_buffer_t *out);
+int grade_store_from_text(const grade_file_t *text, const char *path, uint64_t *written, uint64_t *skipped);
+int grade_store_to_text(const grade_store_t *gs, const char *path);
+
+#endif
@@ -1,70 +1,189 @@
 #include "hw1.h"
+#include "grade_daemon.h"
+#include <sys/wait.h>
 
-int main() 
+const char usage[] = "Usage: gtuStudentGrades [-b commandFile [-f] | -d socket | -c socket]\n"
+                     "  -b commandFile  run the commands in commandFile, one per line, in this process\n"
+                     "  -f              fork a child for every command of the file, as in interactive mode\n"
+                     "  -d socket       serve commands on a Unix socket, keeping grades.txt and its indexes in memory\n"
+                     "  -c socket       send the commands read from standard input to a daemon started with -d\n";
+
+// Run one command in a child process and log how it ended
+void runInChild(char *command)
+{
+    // Fork a child process
+    flushLog();
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        perror("Fork failed");
+        free(command);
+        exit(EXIT_FAILURE);
+    } else if (pid == 0)
+    {
+        // Child process
+        executeCommand(command);
+        free(command);
+        exit(EXIT_SUCCESS);
+    } else
+    {
+        // Parent process
+        int status;
+        waitpid(pid, &status, 0); // Wait for child process to finish
+        writeToLog("Parent process (PID: ");
+        char parentPid[20];
+        sprintf(parentPid, "%d", getpid());
+        writeToLog(parentPid);
+        writeToLog(") waited for child process (PID: ");
+        char childPid[20];
+        sprintf(childPid, "%d", pid);
+        writeToLog(childPid);
+        writeToLog(") with exit status: ");
+        char exitStatus[20];
+        sprintf(exitStatus, "%d\n", WEXITSTATUS(status));
+        writeToLog(exitStatus);
+        writeToLog("Command executed: ");
+        writeToLog(command);
+        writeToLog("\n");
+        flushLog();
+    }
+}
+
+// Forward every command read from standard input to a running daemon
+void runClient(const char *socketPath)
+{
+    int fd = daemon_connect(socketPath);
+    if (fd == -1)
+    {
+        perror("Error connecting to daemon");
+        exit(EXIT_FAILURE);
+    }
+    useCommandScript(STDIN_FILENO);
+
+    while (1)
+    {
+        char *command = readLine();
+        if (strcmp(command, "exit") == 0 || (command[0] == '\0' && inputFinished()))
+        {
+            free(command);
+            break;
+        }
+        if (command[0] != '\0' && daemon_request(fd, command, STDOUT_FILENO) == -1)
+        {
+            perror("Error talking to daemon");
+            free(command);
+            exit(EXIT_FAILURE);
+        }
+        free(command);
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
 {
     char *command = NULL;
+    const char *scriptFile = NULL;
+    const char *daemonSocket = NULL;
+    int isolate = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            scriptFile = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0)
+        {
+            isolate = 1;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            daemonSocket = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            // The client runs no command itself and leaves the daemon's log alone
+            runClient(argv[++i]);
+            exit(EXIT_SUCCESS);
+        } else
+        {
+            write(STDERR_FILENO, usage, strlen(usage));
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // Create or clear the log file
     int logFile = open(LOG_FILE, O_WRONLY | O_TRUNC | O_CREAT, 0666);
-    if (logFile == -1) 
+    if (logFile == -1)
     {
         perror("Error opening log file");
         exit(EXIT_FAILURE);
     }
-    if (close(logFile) == -1) 
+    if (close(logFile) == -1)
     {
         perror("Error closing log file");
         exit(EXIT_FAILURE);
     }
+    atexit(flushLog); // commands that end the process with exit() still get their log written
 
-    while (1) 
+    if (daemonSocket != NULL)
+    {
+        interactive = 0; // nobody can answer sortAll prompts over the socket
+        writeToLog("Daemon started\n");
+        flushLog();
+        if (run_daemon(daemonSocket, "grades.txt", executeCommand) == -1)
+        {
+            perror("Error running daemon");
+            exit(EXIT_FAILURE);
+        }
+        writeToLog("Daemon stopped\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (scriptFile != NULL)
+    {
+        int scriptFd = open(scriptFile, O_RDONLY);
+        if (scriptFd == -1)
+        {
+            perror("Error opening command file");
+            exit(EXIT_FAILURE);
+        }
+        useCommandScript(scriptFd);
+    } else
+    {
+        isolate = 1; // interactive commands always run in their own child
+    }
+
+    while (1)
     {
         command = readLine();
 
         // Exit condition
-        if (strcmp(command, "exit") == 0) 
+        if (strcmp(command, "exit") == 0 || (command[0] == '\0' && inputFinished()))
         {
-            writeToLog(command);
+            writeToLog("exit");
             free(command);
             break;
         }
-
-        // Fork a child process
-        pid_t pid = fork();
-
-        if (pid < 0) 
+        // Nothing to run on blank lines or script comments
+        if (command[0] == '\0' || (scriptFile != NULL && command[0] == '#'))
         {
-            perror("Fork failed");
             free(command);
-            exit(EXIT_FAILURE);
-        } else if (pid == 0) 
+            continue;
+        }
+
+        if (isolate)
         {
-            // Child process
-            executeCommand(command);
-            free(command);
-            exit(EXIT_SUCCESS);
-        } else 
+            runInChild(command);
+        } else
         {
-            // Parent process
-            int status;
-            waitpid(pid, &status, 0); // Wait for child process to finish
-            writeToLog("Parent process (PID: ");
-            char parentPid[20];
-            sprintf(parentPid, "%d", getpid());
-            writeToLog(parentPid);
-            writeToLog(") waited for child process (PID: ");
-            char childPid[20];
-            sprintf(childPid, "%d", pid);
-            writeToLog(childPid);
-            writeToLog(") with exit status: ");
-            char exitStatus[20];
-            sprintf(exitStatus, "%d\n", WEXITSTATUS(status));
-            writeToLog(exitStatus);
-            writeToLog("Command executed: ");
+            // Batch mode: no fork/waitpid round trip per command. Errors that exit
+            // a command end the whole batch, as they would end the child otherwise.
+            writeToLog("Command executed in-process: ");
             writeToLog(command);
             writeToLog("\n");
+            executeCommand(command);
         }
+        free(command);
     }
 
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
@@ -8,31 +8,57 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h> 
+#include <time.h>
+#include "append_writer.h"
+#include "byte_scan.h"
+#include "grade_compact.h"
+#include "grade_file.h"
+#include "grade_import.h"
+#include "grade_index.h"
+#include "grade_sort.h"
+#include "grade_stats.h"
+#include "grade_store.h"
+#include "name_search.h"
+#include "out_buffer.h"
+#include "record_lock.h"
+#include "common.h"
 
 #define LOG_FILE "log.txt"
+#define LINE_READER_SIZE 65536
 
 const char info[] = "gtuStudentGrades grades.txt -> File Creation\n"
                     "addStudentGrade \"Name Surname\" \"AA\" -> Add Student Grade\n"
+                    "bulkAdd \"students.txt\" [-y none|group|every] [-g records] -> Add Every Line Of A File\n"
+                    "import \"students.csv\" [-t threads] [-y none|group|every] -> Import A CSV, TSV Or Grades File In Parallel\n"
+                    "compact [\"grades.txt\"] -> Keep Only The Latest Grade Of Every Student\n"
                     "searchStudent \"Name Surname\" -> Search Student Grades\n"
-                    "sortAll \"grades.txt\" -> Sort All Grades\n"
+                    "searchPrefix \"Name S*\" -> Search Every Student Whose Name Starts With A Prefix\n"
+                    "searchFuzzy \"maxEdits\" \"Name Surname\" -> Search Names Within maxEdits Typos\n"
+                    "sortAll \"grades.txt\" [-k name|grade] [-o asc|desc] [-m memoryMB] [-t threads] [-r] [-s] -> Sort All Grades\n"
                     "showAll \"grades.txt\" -> Show All Grades\n"
                     "listGrades \"grades.txt\" -> List First 5 Entries\n"
-                    "listSome \"numOfEntries\" \"pageNumber\" \"grades.txt\" -> List Specific Entries\n";
+                    "listSome \"numOfEntries\" \"pageNumber\" \"grades.txt\" -> List Specific Entries\n"
+                    "stats \"grades.txt\" [-k topStudents] -> Grade Histogram, Totals And Top Students\n"
+                    "toBinary \"grades.txt\" \"grades.bin\" -> Convert To The Binary Record Format\n"
+                    "toText \"grades.bin\" \"grades.txt\" -> Convert Back To Text\n"
+                    "sortAll, showAll, listGrades and listSome also accept binary files\n";
 
+// Line input. Interactive sessions read one byte at a time so that forked children can
+// read their own answers from stdin; scripts fill the whole buffer at once.
 typedef struct {
-    char name[100];
-    char grade[3];
-} StudentGrade;
+    int fd;
+    size_t capacity; // bytes requested per read(), at most LINE_READER_SIZE
+    char buffer[LINE_READER_SIZE];
+    size_t start;
+    size_t end;
+    int eof;
+} LineReader;
 
-typedef enum {
-    BY_NAME,
-    BY_GRADE
-} SortBy;
+LineReader inputReader = { .fd = STDIN_FILENO, .capacity = 1 };
+int interactive = 1; // 0 while running a command script: sortAll does not prompt
 
-typedef enum {
-    ASCENDING,
-    DESCENDING
-} SortOrder;
+// Log fragments are collected here and written once per command by flushLog
+append_writer_t logWriter = { .fd = -1 };
 
 int compareByName(const void *a, const void *b) 
 {
@@ -59,112 +85,124 @@ int compareByGradeDesc(const void *a, const void *b)
     return -compareByGrade(a, b);
 }
 
-void sortAll(const char *filename, SortBy sortBy, SortOrder sortOrder) 
+// Push everything queued on stdout_buffer to the terminal
+void flushOutput() 
 {
-    size_t num_grades = 0;
-    StudentGrade grades[1000];
-    ssize_t bytes_read;
-    char buffer[1024];
-    char *name;
-    char *surname;
-    char *grade;
-
-    // Open the file for reading
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) 
+    if (out_flush(&stdout_buffer) == -1) 
     {
-        perror("Error opening file");
+        perror("Error writing output");
         exit(EXIT_FAILURE);
     }
+}
 
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
-    {
-        char *ptr = buffer;
-        while ((name = strtok_r(ptr, " ", &ptr)) != NULL &&
-               (surname = strtok_r(NULL, " ", &ptr)) != NULL &&
-               (grade = strtok_r(NULL, "\n", &ptr)) != NULL) 
-        {
-            // Store name and grade
-            strcpy(grades[num_grades].name, name);
-            strcat(grades[num_grades].name, " ");
-            strcat(grades[num_grades].name, surname);
-            strcpy(grades[num_grades].grade, grade);
-
-            // Increment the number of grades
-            num_grades++;
-        }
-    }
+void sortAll(const char *filename, const SortOptions *options) 
+{
+    grade_file_t gf;
 
-    if (bytes_read == -1) 
+    // Map the file for reading
+    if (grade_file_open(&gf, filename) == -1) 
     {
-        perror("Error reading from file");
+        perror("Error opening file");
         exit(EXIT_FAILURE);
     }
 
     // Determine comparison function based on sort criteria
     int (*compareFunction)(const void *, const void *);
-    if (sortBy == BY_NAME) 
+    if (options->sortBy == BY_NAME) 
     {
-        compareFunction = (sortOrder == ASCENDING) ? compareByName : compareByNameDesc;
+        compareFunction = (options->sortOrder == ASCENDING) ? compareByName : compareByNameDesc;
     } else 
     { // BY_GRADE
-        compareFunction = (sortOrder == ASCENDING) ? compareByGrade : compareByGradeDesc;
+        compareFunction = (options->sortOrder == ASCENDING) ? compareByGrade : compareByGradeDesc;
     }
 
-    // Sort the grades
-    qsort(grades, num_grades, sizeof(StudentGrade), compareFunction);
-
-    // Print sorted grades for debugging
-    write(STDOUT_FILENO, "Sorted grades:\n", strlen("Sorted grades:\n"));
-    for (size_t i = 0; i < num_grades; i++) 
+    // Sort the grades within the memory budget and print them
+    grade_store_t store;
+    int binary = grade_store_attach(&store, &gf) == 0;
+    if (!binary && grade_store_probe(gf.fd)) 
     {
-        write(STDOUT_FILENO, grades[i].name, strlen(grades[i].name));
-        write(STDOUT_FILENO, " ", 1);
-        write(STDOUT_FILENO, grades[i].grade, strlen(grades[i].grade));
-        write(STDOUT_FILENO, "\n", 1);
+        perror("Error reading binary file");
+        exit(EXIT_FAILURE);
     }
-
-    // Close the file
-    if (close(fd) == -1) 
+    out_puts(&stdout_buffer, "Sorted grades:\n");
+    if ((binary ? sort_store(&store, options, &stdout_buffer) : sort_grades(&gf, filename, options, compareFunction, &stdout_buffer)) == -1) 
     {
-        perror("Error closing file");
+        perror("Error sorting grades");
         exit(EXIT_FAILURE);
     }
+
+    // Unmap and close the file
+    flushOutput(); // the output may point into the mapping
+    grade_file_close(&gf);
 }
 
 char *readLine()
 {
+    LineReader *reader = &inputReader;
     char* line = (char*)malloc(1024);
-    ssize_t bytes_read = 0;
-    char c;
+    size_t bytes_read = 0;
 
     while(bytes_read < 1023)
     {
-        ssize_t check = read(STDIN_FILENO, &c, 1);
-
-        if(check < 0)
-        {
-            char err_msg[256];
-            strerror_r(errno, err_msg, sizeof(err_msg));
-            write(STDERR_FILENO, err_msg, strlen(err_msg));
-            /* No need to check if the error is caused by write or read, just exit */
-            exit(errno);
-        }
-        /* The allocated buffer for line is full or end of file character occurs */
-        else if(check == 0 || c == '\n') 
+        if(reader->start == reader->end)
         {
-            break; 
+            if(reader->eof)
+            {
+                break;
+            }
+            ssize_t check = read(reader->fd, reader->buffer, reader->capacity);
+
+            if(check < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                char err_msg[256];
+                strerror_r(errno, err_msg, sizeof(err_msg));
+                write(STDERR_FILENO, err_msg, strlen(err_msg));
+                /* No need to check if the error is caused by write or read, just exit */
+                exit(errno);
+            }
+            /* End of file character occurs */
+            if(check == 0)
+            {
+                reader->eof = 1;
+                break;
+            }
+            reader->start = 0;
+            reader->end = (size_t)check;
         }
-        else 
+
+        char c = reader->buffer[reader->start++];
+        if(c == '\n')
         {
-            line[bytes_read] = c;
-            bytes_read = bytes_read + 1; 
+            break;
         }
+        line[bytes_read] = c;
+        bytes_read = bytes_read + 1;
     }
     line[bytes_read] = '\0';
     return line;
 }
 
+// Read commands from fd in large chunks instead of one byte at a time
+void useCommandScript(int fd)
+{
+    inputReader.fd = fd;
+    inputReader.capacity = LINE_READER_SIZE;
+    inputReader.start = 0;
+    inputReader.end = 0;
+    inputReader.eof = 0;
+    interactive = 0;
+}
+
+// True once the input is exhausted and every buffered line has been returned
+int inputFinished()
+{
+    return inputReader.eof && inputReader.start == inputReader.end;
+}
+
 void createFile(char *filename)
 {
     int fd = open(filename, O_CREAT | O_RDWR, 0666);
@@ -183,297 +221,543 @@ void createFile(char *filename)
 void addStudentGrade(const char *name, const char *grade) 
 {
     // Open the file for appending
-    int fd = open("grades.txt", O_WRONLY | O_APPEND | O_CREAT, 0666);
-    if (fd == -1) 
+    append_writer_t *writer = malloc(sizeof(append_writer_t));
+    if (writer == NULL || append_open(writer, "grades.txt", "grades.txt", SYNC_NONE, 0) == -1) 
     {
         perror("Error opening file");
         exit(EXIT_FAILURE);
     }
     
-    // Write the name and grade to the file
-    char buffer[1024];
-    int bytes_written = snprintf(buffer, sizeof(buffer), "%s %s\n", name, grade);
-    if (bytes_written < 0 || (size_t)bytes_written >= sizeof(buffer)) 
+    // Write the name and grade to the file, then record the line in the indexes
+    if (append_record(writer, name, strlen(name), grade, strlen(grade)) == -1 || append_close(writer) == -1) 
     {
-        perror("Error formatting data");
-        close(fd);
+        perror("Error writing to file");
         exit(EXIT_FAILURE);
     }
-    
-    ssize_t bytes_written_to_file = write(fd, buffer, strlen(buffer));
-    if (bytes_written_to_file == -1) 
+    free(writer);
+}
+
+// Append every record of inputFile to grades.txt, committing groupRecords records per write
+void bulkAdd(const char *inputFile, sync_policy_t sync, size_t groupRecords) 
+{
+    grade_file_t input;
+    grade_record_t rec;
+    size_t cursor = 0;
+    unsigned long added = 0;
+    struct timespec start, end;
+
+    if (grade_file_open(&input, inputFile) == -1) 
     {
-        perror("Error writing to file");
-        close(fd);
-        exit(EXIT_FAILURE);
+        perror("Error opening file");
+        return;
     }
-    
-    // Close the file
-    if (close(fd) == -1) 
+    append_writer_t *writer = malloc(sizeof(append_writer_t));
+    if (writer == NULL || append_open(writer, "grades.txt", "grades.txt", sync, groupRecords) == -1) 
     {
-        perror("Error closing file");
-        exit(EXIT_FAILURE);
+        perror("Error opening grades.txt");
+        free(writer);
+        grade_file_close(&input);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = 0;
+    while (result == 0 && grade_file_next(&input, &cursor, &rec)) 
+    {
+        result = append_record(writer, rec.name, rec.name_len, rec.grade, rec.grade_len);
+        added += result == 0;
+    }
+    if (append_close(writer) == -1 || result == -1) 
+    {
+        perror("Error writing to grades.txt");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    char report[256];
+    snprintf(report, sizeof(report), "Added %lu records in %.3f s (%.0f appends/s, %lu writes, %lu syncs)\n",
+             added, seconds, seconds > 0 ? (double)added / seconds : 0.0, writer->commits, writer->syncs);
+    out_puts(&stdout_buffer, report);
+
+    free(writer);
+    grade_file_close(&input);
+}
+
+// Validate, normalize and append every record of a CSV, TSV or grades file to grades.txt
+void importGrades(const char *inputFile, int threads, sync_policy_t sync) 
+{
+    import_report_t report;
+    struct timespec start, end;
+    char message[256];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = grade_import(inputFile, "grades.txt", threads, sync, &report);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (result == -1) 
+    {
+        perror("Error importing file");
+        if (report.imported == 0) 
+        {
+            return;
+        }
+    }
+
+    const char *format = report.delimiter == '\t' ? "tab separated" : report.delimiter == ',' ? "comma separated" :
+                         report.delimiter == ';' ? "semicolon separated" : "space separated";
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    snprintf(message, sizeof(message), "Imported %llu records (%llu bytes) from a %s file in %.3f s with %d threads (%.0f records/s, %lu appends)\n",
+             (unsigned long long)report.imported, (unsigned long long)report.bytes, format, seconds, threads,
+             seconds > 0 ? (double)report.imported / seconds : 0.0, report.rounds);
+    out_puts(&stdout_buffer, message);
+    if (report.header) 
+    {
+        out_puts(&stdout_buffer, "Skipped the header line.\n");
+    }
+    if (report.rejected > 0) 
+    {
+        snprintf(message, sizeof(message), "Rejected %llu invalid lines, the first at line %llu.\n",
+                 (unsigned long long)report.rejected, (unsigned long long)report.first_rejected);
+        out_puts(&stdout_buffer, message);
+    }
+}
+
+// Drop every record that a later grade of the same student overrides
+void compactFile(const char *filename) 
+{
+    grade_file_t gf;
+    grade_store_t store;
+    compact_report_t report;
+    struct timespec start, end;
+    char message[256];
+
+    if (grade_file_open(&gf, filename) == -1) 
+    {
+        perror("Error opening file");
+        return;
+    }
+    if (grade_store_attach(&store, &gf) == 0) 
+    {
+        out_puts(&stdout_buffer, "Binary grade files hold one record per student already.\n");
+        grade_file_close(&gf);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = grade_compact(&gf, filename, &report);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    grade_file_close(&gf);
+    if (result == -1 && !report.rewritten) 
+    {
+        perror(errno == EAGAIN ? "File changed while compacting, try again" : "Error compacting file");
+        return;
+    }
+    if (result == -1) 
+    {
+        perror("Error writing indexes"); // they are rebuilt by the next search
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    if (!report.rewritten) 
+    {
+        snprintf(message, sizeof(message), "Nothing to compact: %llu records, one per student.\n", (unsigned long long)report.records);
+    } else 
+    {
+        snprintf(message, sizeof(message), "Compacted %llu records to %llu students, %llu bytes to %llu bytes in %.3f s\n",
+                 (unsigned long long)report.records, (unsigned long long)report.students,
+                 (unsigned long long)report.old_size, (unsigned long long)report.new_size, seconds);
     }
+    out_puts(&stdout_buffer, message);
 }
 
 void searchStudent(const char *name)
 {
-    char buffer[1024];
-    ssize_t bytes_read;
+    grade_file_t gf;
+    grade_record_t rec;
+    name_index_t ni;
+    uint64_t offset;
+    size_t cursor = 0;
+    size_t name_len = strlen(name);
     int found = 0;
 
-    int fd = open("grades.txt", O_RDONLY);
-    if (fd == -1) 
+    if (grade_file_open(&gf, "grades.txt") == -1) 
     {
         perror("Open Error");
         return;  // Exit the function early if file open fails
     }
+
+    // Binary search the sidecar name index, falling back to a full scan if it cannot be used
+    if (name_index_open(&ni, "grades.txt", &gf) == 0) 
+    {
+        found = name_index_lookup(&ni, &gf, name, name_len, &offset);
+        if (found && grade_file_record_at(&gf, offset, &rec) == 0) 
+        {
+            out_write(&stdout_buffer, rec.line, rec.line_len);
+            out_write(&stdout_buffer, "\n", 1);
+        }
+        name_index_close(&ni);
+        cursor = gf.size; // skip the scan below
+    }
     
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
-    {
-        // Null-terminate the buffer to prevent strtok from going beyond it
-        buffer[bytes_read] = '\0';
-
-        // Tokenize the buffer using newline as the delimiter
-        char *saveptr;
-        char *line = strtok_r(buffer, "\n", &saveptr);
-        while (line != NULL) {
-            // Extract student name and surname from the line
-            char *student_name = strtok(line, " ");
-            char *student_surname = strtok(NULL, " ");
-            
-            // Concatenate name and surname to form the full name
-            char student_fullname[100]; // Assuming maximum length for name and surname is 50 characters each
-            strcpy(student_fullname, student_name);
-            strcat(student_fullname, " ");
-            strcat(student_fullname, student_surname);
-            // Skip to the next token, which should be the grade
-            char *student_grade = strtok(NULL, " ");
-            
-            // Check if the student name matches the provided name
-            if (strcmp(student_fullname, name) == 0) 
-            {
-                found = 1;
-                write(STDOUT_FILENO, student_fullname, strlen(student_fullname));
-                write(STDOUT_FILENO, " ", 1);
-                write(STDOUT_FILENO, student_grade, strlen(student_grade));
-                write(STDOUT_FILENO, "\n", 1);
-                break;  // Exit the loop once a match is found
-            }
-            // Move to the next line
-            line = strtok_r(NULL, "\n", &saveptr);
+    while (grade_file_next(&gf, &cursor, &rec)) 
+    {
+        // Check if the student name matches the provided name
+        if (rec.name_len == name_len && memcmp(rec.name, name, name_len) == 0) 
+        {
+            found = 1;
+            out_write(&stdout_buffer, rec.line, rec.line_len);
+            out_write(&stdout_buffer, "\n", 1);
+            break;  // Exit the loop once a match is found
         }
     }
     
     if (!found) 
     {
-        printf("Student not found.\n");
+        out_puts(&stdout_buffer, "Student not found.\n");
     }
     
-    if (close(fd) == -1) 
+    flushOutput(); // the output may point into the mapping
+    grade_file_close(&gf);
+}
+
+// Print every student whose name starts with pattern, or is at most maxDistance edits away from it
+void searchMatching(const char *pattern, int fuzzy, unsigned maxDistance) 
+{
+    grade_file_t gf;
+    name_index_t ni;
+    uint64_t found = 0;
+
+    if (grade_file_open(&gf, "grades.txt") == -1) 
     {
-        perror("Close Error");
+        perror("Open Error");
+        return;
     }
-}
 
+    // The sorted name index doubles as a trie; without it the file is scanned
+    int indexed = name_index_open(&ni, "grades.txt", &gf) == 0;
+    int result = fuzzy ? name_search_fuzzy(indexed ? &ni : NULL, &gf, pattern, strlen(pattern), maxDistance, &stdout_buffer, &found)
+                       : name_search_prefix(indexed ? &ni : NULL, &gf, pattern, strlen(pattern), &stdout_buffer, &found);
+    if (result == -1) 
+    {
+        perror("Error searching names");
+    } else if (found == 0) 
+    {
+        out_puts(&stdout_buffer, "Student not found.\n");
+    } else 
+    {
+        char message[64];
+        snprintf(message, sizeof(message), "%llu students found.\n", (unsigned long long)found);
+        out_puts(&stdout_buffer, message);
+    }
 
-void displayAll(const char *filename) 
+    flushOutput(); // the output may point into the mapping
+    if (indexed) 
+    {
+        name_index_close(&ni);
+    }
+    grade_file_close(&gf);
+}
+
+void showStats(const char *filename, size_t topK) 
 {
-    ssize_t bytes_read;
-    char buffer[1024];
-    // Open the file for reading
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) 
+    grade_file_t gf;
+    // Map the file for reading
+    if (grade_file_open(&gf, filename) == -1) 
     {
         perror("Error opening file");
         exit(EXIT_FAILURE);
     }
 
-    // Read and display all student grades from the file
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
+    if (grade_stats(&gf, topK, &stdout_buffer) == -1) 
     {
-        write(STDOUT_FILENO, buffer, bytes_read);
+        perror("Error computing statistics");
     }
 
-    // Check for read error
-    if (bytes_read == -1) 
+    flushOutput(); // the output may point into the mapping
+    grade_file_close(&gf);
+}
+
+// Write lines of a grades file, which start at data, leaving out the lines of writers that
+// died mid-append: only those hold NUL bytes
+void putLines(const char *data, size_t len) 
+{
+    const char *hole;
+    while ((hole = scan_find(data, len, '\0')) != NULL) 
     {
-        perror("Error reading from file");
-        exit(EXIT_FAILURE);
+        const char *newline = scan_find_last(data, (size_t)(hole - data), '\n');
+        out_write(&stdout_buffer, data, newline != NULL ? (size_t)(newline - data) + 1 : 0);
+
+        newline = scan_find(hole, len - (size_t)(hole - data), '\n');
+        size_t skip = newline != NULL ? (size_t)(newline - data) + 1 : len;
+        data += skip;
+        len -= skip;
     }
+    out_write(&stdout_buffer, data, len);
+}
 
-    // Close the file
-    if (close(fd) == -1) 
+void displayAll(const char *filename) 
+{
+    grade_file_t gf;
+    // Map the file for reading
+    if (grade_file_open(&gf, filename) == -1) 
     {
-        perror("Error closing file");
+        perror("Error opening file");
         exit(EXIT_FAILURE);
     }
+
+    // Display all student grades straight from the mapping
+    grade_store_t store;
+    if (grade_store_attach(&store, &gf) == 0) 
+    {
+        if (grade_store_put(&store, 0, store.count, &stdout_buffer) == -1) 
+        {
+            flushOutput();
+            perror("Error reading binary file");
+            exit(EXIT_FAILURE);
+        }
+    } else 
+    {
+        putLines(gf.data, gf.size);
+    }
+
+    flushOutput();
+    grade_file_close(&gf);
+}
+
+// Offset just past the n-th newline at or after start, or the end of the file
+size_t skipLines(const grade_file_t *gf, size_t start, long lines) 
+{
+    if (lines <= 0 || start >= gf->size) 
+    {
+        return start;
+    }
+    const char *newline = scan_nth(gf->data + start, gf->size - start, '\n', (size_t)lines);
+    return newline != NULL ? (size_t)(newline - gf->data) + 1 : gf->size;
 }
 
 void displayFirst5(const char *filename) 
 {
-    ssize_t bytes_read;
-    char buffer[1024];
-    int lines_read = 0; // Counter for lines read
-    // Open the file for reading
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) 
+    grade_file_t gf;
+    // Map the file for reading
+    if (grade_file_open(&gf, filename) == -1) 
     {
         perror("Error opening file");
         exit(EXIT_FAILURE);
     }
 
-    // Read and display the first 5 student grades from the file
-    while (lines_read < 5) // Loop until 5 lines are read
+    // Display the first 5 student grades from the file
+    grade_store_t store;
+    if (grade_store_attach(&store, &gf) == 0) 
     {
-        bytes_read = read(fd, buffer, sizeof(buffer));
-        if (bytes_read <= 0) 
+        if (grade_store_put(&store, 0, 5, &stdout_buffer) == -1) 
         {
-            break; // End of file reached or error occurred
-        }
-        // Count lines in the buffer
-        for (int i = 0; i < bytes_read; i++) 
-        {
-            if (buffer[i] == '\n') 
-            {
-                lines_read++;
-                if (lines_read >= 5) 
-                {
-                    // If 5 lines are read, exit the loop
-                    bytes_read = i + 1; // Adjust bytes_read to stop reading
-                    break;
-                }
-            }
+            flushOutput();
+            perror("Error reading binary file");
+            exit(EXIT_FAILURE);
         }
-        // Write buffer content to stdout
-        write(STDOUT_FILENO, buffer, bytes_read);
-    }
-
-    // Close the file
-    if (close(fd) == -1) 
+    } else 
     {
-        perror("Error closing file");
-        exit(EXIT_FAILURE);
+        putLines(gf.data, skipLines(&gf, 0, 5));
     }
+
+    flushOutput();
+    grade_file_close(&gf);
 }
 
 void displayPage(const char *filename, int numOfEntries, int pageNumber) 
 {
-    int fd, lines_read = 0, offset = 0;
-    ssize_t bytes_read;
-    char buffer[1024];
+    struct stat st;
+    uint64_t start, end;
 
     // Open the file in read-only mode
-    fd = open(filename, O_RDONLY);
-    if (fd == -1) 
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) 
     {
         perror("Error opening file");
         exit(EXIT_FAILURE);
     }
 
-    // Calculate the offset based on the number of newline characters
-    while (lines_read < (pageNumber - 1) * numOfEntries) 
+    if (numOfEntries <= 0 || pageNumber <= 0) 
+    {
+        out_puts(&stdout_buffer, "Invalid page request.\n");
+        close(fd);
+        return;
+    }
+
+    // Binary records need no index: the page starts at record (pageNumber - 1) * numOfEntries
+    if (grade_store_probe(fd)) 
     {
-        bytes_read = read(fd, buffer, sizeof(buffer));
-        if (bytes_read == -1) 
+        grade_file_t gf;
+        grade_store_t store;
+        uint64_t first = (uint64_t)(pageNumber - 1) * numOfEntries;
+        close(fd);
+        if (grade_file_open(&gf, filename) == -1 || grade_store_attach(&store, &gf) == -1) 
         {
-            perror("Error reading from file");
+            perror("Error reading binary file");
             exit(EXIT_FAILURE);
         }
-        if (bytes_read == 0) 
+        if (first >= store.count) 
         {
-            // Reached end of file before reaching the desired page
-            write(STDOUT_FILENO, "End of file reached.\n", strlen("End of file reached.\n"));
-            if(close(fd) == -1)
-            {
-                perror("Error closing file");
-                exit(EXIT_FAILURE);
-            }
-            return;
-        }
-        for (int i = 0; i < bytes_read; i++) 
+            out_puts(&stdout_buffer, "End of file reached.\n");
+        } else 
         {
-            if (buffer[i] == '\n') 
-            {
-                lines_read++;
-            }
-            if (lines_read >= (pageNumber - 1) * numOfEntries) 
+            if (grade_store_put(&store, first, (uint64_t)numOfEntries, &stdout_buffer) == -1) 
             {
-                offset += i + 1;
-                break;
+                flushOutput();
+                perror("Error reading binary file");
+                exit(EXIT_FAILURE);
             }
         }
+        flushOutput();
+        grade_file_close(&gf);
+        return;
     }
 
-    // Seek to the starting line
-    lseek(fd, offset, SEEK_SET);
+    // Look up the byte range of the page in the line index
+    // Appends still being written are not part of any page yet
+    uint64_t size = record_visible_size(fd, (size_t)st.st_size);
+    int found = line_index_range(filename, fd, size, (uint64_t)(pageNumber - 1) * numOfEntries, numOfEntries, &start, &end);
+    if (found == -1) 
+    {
+        perror("Error reading line index");
+        exit(EXIT_FAILURE);
+    }
+    if (found == 0) 
+    {
+        // Reached end of file before reaching the desired page
+        out_puts(&stdout_buffer, "End of file reached.\n");
+        close(fd);
+        return;
+    }
 
-    // Read and display lines until the desired number of lines are displayed or the end of file is reached
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) 
+    // Read the whole page with one pread and display it with one write
+    size_t len = (size_t)(end - start);
+    char *page = malloc(len);
+    if (page == NULL) 
     {
-        // Output the read buffer
-        for (int i = 0; i < bytes_read; i++) 
+        perror("Error allocating page buffer");
+        exit(EXIT_FAILURE);
+    }
+    size_t bytes_read = 0;
+    while (bytes_read < len) 
+    {
+        ssize_t check = pread(fd, page + bytes_read, len - bytes_read, (off_t)(start + bytes_read));
+        if (check == -1) 
         {
-            if (buffer[i] == '\n') 
-            {
-                lines_read++;
-            }
-            if (lines_read >= pageNumber * numOfEntries) 
-            {
-                break;
-            }
-            write(STDOUT_FILENO, &buffer[i], 1);
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
         }
-        if (lines_read >= pageNumber * numOfEntries) 
+        if (check == 0) 
         {
             break;
         }
+        bytes_read += (size_t)check;
     }
+    putLines(page, bytes_read);
+    flushOutput();
+    free(page);
 
-    // Check for errors or end of file
-    if (bytes_read == -1) 
+    // Close the file
+    if (close(fd) == -1) 
     {
-        perror("Error reading from file");
+        perror("Error closing file");
         exit(EXIT_FAILURE);
     }
+}
 
-    // Close the file
-    if (close(fd) == -1) 
+// Sidecar indexes describe the old contents of a file that was just replaced
+void dropIndexes(const char *filename) 
+{
+    char path[512];
+    index_path(path, sizeof(path), filename, NAME_INDEX_SUFFIX);
+    unlink(path);
+    index_path(path, sizeof(path), filename, LINE_INDEX_SUFFIX);
+    unlink(path);
+}
+
+void convertToBinary(const char *textFile, const char *binaryFile) 
+{
+    grade_file_t gf;
+    grade_store_t store;
+    uint64_t written = 0, skipped = 0;
+
+    if (grade_file_open(&gf, textFile) == -1) 
     {
-        perror("Error closing file");
+        perror("Error opening file");
+        exit(EXIT_FAILURE);
+    }
+    if (grade_store_attach(&store, &gf) == 0) 
+    {
+        out_puts(&stdout_buffer, "File is already binary.\n");
+    } else if (grade_store_from_text(&gf, binaryFile, &written, &skipped) == -1) 
+    {
+        perror("Error writing binary file");
+    } else 
+    {
+        dropIndexes(binaryFile);
+        char message[128];
+        snprintf(message, sizeof(message), "Converted %llu records, skipped %llu that do not fit.\n",
+                 (unsigned long long)written, (unsigned long long)skipped);
+        out_puts(&stdout_buffer, message);
+    }
+    grade_file_close(&gf);
+}
+
+void convertToText(const char *binaryFile, const char *textFile) 
+{
+    grade_file_t gf;
+    grade_store_t store;
+
+    if (grade_file_open(&gf, binaryFile) == -1) 
+    {
+        perror("Error opening file");
         exit(EXIT_FAILURE);
     }
+    if (grade_store_attach(&store, &gf) == -1) 
+    {
+        out_puts(&stdout_buffer, "File is not a binary grade file.\n");
+    } else if (grade_store_to_text(&store, textFile) == -1) 
+    {
+        perror("Error writing text file");
+    } else 
+    {
+        dropIndexes(textFile);
+        char message[64];
+        snprintf(message, sizeof(message), "Converted %llu records.\n", (unsigned long long)store.count);
+        out_puts(&stdout_buffer, message);
+    }
+    grade_file_close(&gf);
 }
 
 void writeToLog(const char *message) 
 {
-    // Open the log file in append mode
-    int logFile = open(LOG_FILE, O_WRONLY | O_APPEND | O_CREAT, 0666);
-    if (logFile == -1) 
+    // Open the log file in append mode once; messages are buffered until flushLog
+    if (logWriter.fd == -1 && append_open(&logWriter, LOG_FILE, NULL, SYNC_NONE, 0) == -1) 
     {
         perror("Error opening log file");
         exit(EXIT_FAILURE);
     }
 
-    // Write the message to the log file
-    ssize_t bytes_written = write(logFile, message, strlen(message));
-    if (bytes_written == -1) 
+    if (append_write(&logWriter, message, strlen(message)) == -1) 
     {
         perror("Error writing to log file");
-        close(logFile);
         exit(EXIT_FAILURE);
     }
+}
 
-    // Close the log file
-    if (close(logFile) == -1) 
+// Write the buffered log messages. Called after every command and before every fork,
+// so that a child never inherits messages its parent will write as well.
+void flushLog() 
+{
+    if (logWriter.fd != -1 && append_commit(&logWriter) == -1) 
     {
-        perror("Error closing log file");
+        perror("Error writing to log file");
         exit(EXIT_FAILURE);
     }
 }
 
 void executeCommand(const char *command) 
 {
+    output_syscalls = 0;
     char *token = strtok((char *)command, " ");
     if (strcmp(token, "gtuStudentGrades") == 0) 
     {
@@ -486,7 +770,7 @@ void executeCommand(const char *command)
         } else 
         {
             // If no filename is provided, print usage information
-            write(STDOUT_FILENO, info, strlen(info));
+            out_write(&stdout_buffer, info, strlen(info));
         }
     } else if (strcmp(token, "addStudentGrade") == 0) 
     {
@@ -503,6 +787,70 @@ void executeCommand(const char *command)
 
         // Call the addStudentGrade function with the parsed name and grade
         addStudentGrade(fullName, grade);
+    } else if (strcmp(token, "bulkAdd") == 0) 
+    {
+        char *inputFile = strtok(NULL, " ");
+        sync_policy_t sync = SYNC_NONE;
+        size_t groupRecords = APPEND_GROUP_RECORDS;
+
+        char *option;
+        while ((option = strtok(NULL, " ")) != NULL) 
+        {
+            char *value = strtok(NULL, " ");
+            if (strcmp(option, "-y") == 0 && value != NULL && parse_sync_policy(value, &sync) == 0) 
+            {
+                continue;
+            } else if (strcmp(option, "-g") == 0 && value != NULL && atoi(value) > 0) 
+            {
+                groupRecords = (size_t)atoi(value);
+            } else 
+            {
+                out_puts(&stdout_buffer, "Ignoring unknown bulkAdd option: ");
+                out_puts(&stdout_buffer, option);
+                out_puts(&stdout_buffer, "\n");
+            }
+        }
+        if (inputFile == NULL) 
+        {
+            out_puts(&stdout_buffer, "Usage: bulkAdd \"students.txt\" [-y none|group|every] [-g records]\n");
+        } else 
+        {
+            bulkAdd(inputFile, sync, groupRecords);
+        }
+    } else if (strcmp(token, "import") == 0) 
+    {
+        char *inputFile = strtok(NULL, " ");
+        int threads = IMPORT_DEFAULT_THREADS;
+        sync_policy_t sync = SYNC_NONE;
+
+        char *option;
+        while ((option = strtok(NULL, " ")) != NULL) 
+        {
+            char *value = strtok(NULL, " ");
+            if (strcmp(option, "-t") == 0 && value != NULL && atoi(value) > 0) 
+            {
+                threads = atoi(value) > IMPORT_MAX_THREADS ? IMPORT_MAX_THREADS : atoi(value);
+            } else if (strcmp(option, "-y") == 0 && value != NULL && parse_sync_policy(value, &sync) == 0) 
+            {
+                continue;
+            } else 
+            {
+                out_puts(&stdout_buffer, "Ignoring unknown import option: ");
+                out_puts(&stdout_buffer, option);
+                out_puts(&stdout_buffer, "\n");
+            }
+        }
+        if (inputFile == NULL) 
+        {
+            out_puts(&stdout_buffer, "Usage: import \"students.csv\" [-t threads] [-y none|group|every]\n");
+        } else 
+        {
+            importGrades(inputFile, threads, sync);
+        }
+    } else if (strcmp(token, "compact") == 0) 
+    {
+        char *filename = strtok(NULL, " ");
+        compactFile(filename != NULL ? filename : "grades.txt");
     } else if (strcmp(token, "searchStudent") == 0) 
     {
         // Handle searchStudent command
@@ -513,14 +861,90 @@ void executeCommand(const char *command)
         char full_name[256]; // Assuming maximum length of name and surname is 255 characters
         snprintf(full_name, sizeof(full_name), "%s %s", name, surname);
         searchStudent(full_name); // Send the full name to the searchStudent function
+    } else if (strcmp(token, "searchPrefix") == 0) 
+    {
+        // Everything after the command is the prefix; a trailing * is optional
+        char *prefix = strtok(NULL, "");
+        if (prefix == NULL) 
+        {
+            prefix = "";
+        }
+        size_t len = strlen(prefix);
+        if (len > 0 && prefix[len - 1] == '*') 
+        {
+            prefix[len - 1] = '\0';
+        }
+        searchMatching(prefix, 0, 0);
+    } else if (strcmp(token, "searchFuzzy") == 0) 
+    {
+        char *distance = strtok(NULL, " ");
+        char *name = strtok(NULL, "");
+        if (distance == NULL || name == NULL || atoi(distance) < 0 || atoi(distance) > NAME_SEARCH_MAX_DISTANCE) 
+        {
+            out_puts(&stdout_buffer, "Usage: searchFuzzy \"maxEdits\" \"Name Surname\" with maxEdits from 0 to 8\n");
+        } else 
+        {
+            searchMatching(name, 1, (unsigned)atoi(distance));
+        }
     } else if (strcmp(token, "sortAll") == 0) 
     {
         char *filename = strtok(NULL, " ");
-        int choice;
-        write(STDOUT_FILENO, "Enter 1 for sorting by name or 2 for sorting by grade: ", strlen("Enter 1 for sorting by name or 2 for sorting by grade: "));
-        char choiceStr[2];
-        read(STDIN_FILENO, choiceStr, sizeof(choiceStr));
-        choice = atoi(choiceStr);
+        SortOptions options;
+        options.memoryBudget = (size_t)DEFAULT_SORT_MEMORY_MB * 1024 * 1024;
+        options.threads = 1;
+        options.report = 0;
+        options.nameOrder = 0;
+        int choice = 0;
+        int sortOrderChoice = 0;
+
+        // Optional flags after the file name
+        char *option;
+        while ((option = strtok(NULL, " ")) != NULL) 
+        {
+            if (strcmp(option, "-r") == 0) 
+            {
+                options.report = 1;
+                continue;
+            }
+            if (strcmp(option, "-s") == 0) 
+            {
+                options.nameOrder = 1;
+                continue;
+            }
+            char *value = strtok(NULL, " ");
+            if (strcmp(option, "-k") == 0 && value != NULL && (strcmp(value, "name") == 0 || strcmp(value, "grade") == 0)) 
+            {
+                choice = strcmp(value, "name") == 0 ? 1 : 2;
+            } else if (strcmp(option, "-o") == 0 && value != NULL && (strcmp(value, "asc") == 0 || strcmp(value, "desc") == 0)) 
+            {
+                sortOrderChoice = strcmp(value, "asc") == 0 ? 1 : 2;
+            } else if (strcmp(option, "-m") == 0 && value != NULL && atoi(value) > 0) 
+            {
+                options.memoryBudget = (size_t)atoi(value) * 1024 * 1024;
+            } else if (strcmp(option, "-t") == 0 && value != NULL && atoi(value) > 0) 
+            {
+                options.threads = atoi(value) > MAX_SORT_THREADS ? MAX_SORT_THREADS : atoi(value);
+            } else 
+            {
+                out_puts(&stdout_buffer, "Ignoring unknown sortAll option: ");
+                out_puts(&stdout_buffer, option);
+                out_puts(&stdout_buffer, "\n");
+            }
+        }
+
+        // Ask for whatever the flags left open; scripts fall back to name, ascending
+        if (choice == 0 && !interactive) 
+        {
+            choice = 1;
+        }
+        if (choice == 0) 
+        {
+            out_puts(&stdout_buffer, "Enter 1 for sorting by name or 2 for sorting by grade: ");
+            flushOutput(); // the prompt must show before we block on the answer
+            char *choiceStr = readLine();
+            choice = atoi(choiceStr);
+            free(choiceStr);
+        }
 
         SortBy sortBy;
         switch (choice) 
@@ -532,16 +956,23 @@ void executeCommand(const char *command)
                 sortBy = BY_GRADE;
                 break;
             default:
-                write(STDOUT_FILENO, "Invalid choice. Defaulting to sorting by name.\n", strlen("Invalid choice. Defaulting to sorting by name.\n"));
+                out_puts(&stdout_buffer, "Invalid choice. Defaulting to sorting by name.\n");
                 sortBy = BY_NAME;
                 break;
         }
 
-        int sortOrderChoice;
-        write(STDOUT_FILENO, "Enter 1 for ascending order or 2 for descending order: ", strlen("Enter 1 for ascending order or 2 for descending order: "));
-        char sortOrderChoiceStr[2];
-        read(STDIN_FILENO, sortOrderChoiceStr, sizeof(sortOrderChoiceStr));
-        sortOrderChoice = atoi(sortOrderChoiceStr);
+        if (sortOrderChoice == 0 && !interactive) 
+        {
+            sortOrderChoice = 1;
+        }
+        if (sortOrderChoice == 0) 
+        {
+            out_puts(&stdout_buffer, "Enter 1 for ascending order or 2 for descending order: ");
+            flushOutput();
+            char *sortOrderChoiceStr = readLine();
+            sortOrderChoice = atoi(sortOrderChoiceStr);
+            free(sortOrderChoiceStr);
+        }
 
         SortOrder sortOrder;
         switch (sortOrderChoice) 
@@ -553,12 +984,56 @@ void executeCommand(const char *command)
                 sortOrder = DESCENDING;
                 break;
             default:
-                write(STDOUT_FILENO, "Invalid choice. Defaulting to ascending order.\n", strlen("Invalid choice. Defaulting to ascending order.\n"));
+                out_puts(&stdout_buffer, "Invalid choice. Defaulting to ascending order.\n");
                 sortOrder = ASCENDING;
                 break;
         }
-        printf("Sorting by %s in %s order...\n", sortBy == BY_NAME ? "name" : "grade", sortOrder == ASCENDING ? "ascending" : "descending");
-        sortAll(filename, sortBy, sortOrder);
+        char sortingMessage[64];
+        snprintf(sortingMessage, sizeof(sortingMessage), "Sorting by %s in %s order...\n", sortBy == BY_NAME ? "name" : "grade", sortOrder == ASCENDING ? "ascending" : "descending");
+        out_puts(&stdout_buffer, sortingMessage);
+        options.sortBy = sortBy;
+        options.sortOrder = sortOrder;
+        sortAll(filename, &options);
+    } else if (strcmp(token, "toBinary") == 0 || strcmp(token, "toText") == 0) 
+    {
+        char *source = strtok(NULL, " ");
+        char *target = strtok(NULL, " ");
+        if (source == NULL || target == NULL) 
+        {
+            out_puts(&stdout_buffer, "Usage: toBinary \"grades.txt\" \"grades.bin\" or toText \"grades.bin\" \"grades.txt\"\n");
+        } else if (strcmp(token, "toBinary") == 0) 
+        {
+            convertToBinary(source, target);
+        } else 
+        {
+            convertToText(source, target);
+        }
+    } else if (strcmp(token, "stats") == 0) 
+    {
+        char *filename = strtok(NULL, " ");
+        size_t topK = STATS_DEFAULT_TOP;
+
+        char *option;
+        while ((option = strtok(NULL, " ")) != NULL) 
+        {
+            char *value = strtok(NULL, " ");
+            if (strcmp(option, "-k") == 0 && value != NULL && atoi(value) >= 0) 
+            {
+                topK = atoi(value) > STATS_MAX_TOP ? STATS_MAX_TOP : (size_t)atoi(value);
+            } else 
+            {
+                out_puts(&stdout_buffer, "Ignoring unknown stats option: ");
+                out_puts(&stdout_buffer, option);
+                out_puts(&stdout_buffer, "\n");
+            }
+        }
+        if (filename == NULL) 
+        {
+            out_puts(&stdout_buffer, "Usage: stats \"grades.txt\" [-k topStudents]\n");
+        } else 
+        {
+            showStats(filename, topK);
+        }
     } else if (strcmp(token, "showAll") == 0) 
     {
         // Handle showAll command
@@ -578,10 +1053,17 @@ void executeCommand(const char *command)
         displayPage(filename, numOfEntries, pageNumber);
     } else 
     {
-        write(STDOUT_FILENO, "Invalid command: ", strlen("Invalid command: "));
-        write(STDOUT_FILENO, command, strlen(command));
-        write(STDOUT_FILENO, "\n", 1);
+        out_puts(&stdout_buffer, "Invalid command: ");
+        out_puts(&stdout_buffer, command);
+        out_puts(&stdout_buffer, "\n");
     }
+    flushOutput();
+
+    // Report how many output syscalls the command needed
+    char syscallMessage[128];
+    snprintf(syscallMessage, sizeof(syscallMessage), "Command %s issued %lu output syscalls\n", token != NULL ? token : "", output_syscalls);
+    writeToLog(syscallMessage);
+    flushLog();
 }
 
 #endif // HW1_H
@@ -0,0 +1,338 @@
+#include "name_search.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Offsets of matching records
+typedef struct {
+    uint64_t *items;
+    size_t count;
+    size_t capacity;
+} match_list_t;
+
+// Levenshtein rows shared between names with a common prefix: row d holds the distances
+// between the first d name bytes and every prefix of the pattern
+typedef struct {
+    const char *pattern;
+    size_t m;
+    unsigned k;
+    unsigned *rows;
+} fuzzy_t;
+
+// qsort has no context argument, so the file of the matches being sorted is kept here
+static const grade_file_t *match_file = NULL;
+
+static void name_of(const grade_file_t *gf, uint64_t offset, const char **name, size_t *len)
+{
+    grade_record_t rec;
+    if (grade_file_record_at(gf, (size_t)offset, &rec) == 0)
+    {
+        *name = rec.name;
+        *len = rec.name_len;
+    } else
+    {
+        *name = "";
+        *len = 0;
+    }
+}
+
+static int starts_with(const char *name, size_t len, const char *prefix, size_t prefix_len)
+{
+    return len >= prefix_len && memcmp(name, prefix, prefix_len) == 0;
+}
+
+// Names whose length differs from the pattern by more than k need more than k edits
+static int length_within(size_t name_len, size_t len, unsigned k)
+{
+    return (name_len > len ? name_len - len : len - name_len) <= k;
+}
+
+static int match_push(match_list_t *list, uint64_t offset)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        uint64_t *items = realloc(list->items, capacity * sizeof(uint64_t));
+        if (items == NULL)
+        {
+            return -1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = offset;
+    return 0;
+}
+
+static int compare_match(uint64_t a, uint64_t b)
+{
+    const char *name_a, *name_b;
+    size_t len_a, len_b;
+    name_of(match_file, a, &name_a, &len_a);
+    name_of(match_file, b, &name_b, &len_b);
+    int result = compare_names(name_a, len_a, name_b, len_b);
+    return result != 0 ? result : (a > b) - (a < b);
+}
+
+static int compare_match_qsort(const void *a, const void *b)
+{
+    return compare_match(*(const uint64_t *)a, *(const uint64_t *)b);
+}
+
+static int put_line(const grade_file_t *gf, uint64_t offset, out_buffer_t *out)
+{
+    grade_record_t rec;
+    if (grade_file_record_at(gf, (size_t)offset, &rec) == -1)
+    {
+        return 0;
+    }
+    if (out_write(out, rec.line, rec.line_len) == -1 || out_write(out, "\n", 1) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Print the run matches, already in name order, merged with the tail matches
+static int put_matches(const grade_file_t *gf, match_list_t *run, match_list_t *tail, out_buffer_t *out)
+{
+    size_t i = 0, j = 0;
+    int result = 0;
+
+    match_file = gf;
+    qsort(tail->items, tail->count, sizeof(uint64_t), compare_match_qsort);
+    while (result == 0 && (i < run->count || j < tail->count))
+    {
+        if (j == tail->count || (i < run->count && compare_match(run->items[i], tail->items[j]) <= 0))
+        {
+            result = put_line(gf, run->items[i++], out);
+        } else
+        {
+            result = put_line(gf, tail->items[j++], out);
+        }
+    }
+    return result;
+}
+
+// First position at or after low in the sorted run whose name does not start with prefix.
+// The names from low on that do start with it are contiguous, so this is a binary search.
+static uint64_t prefix_end(const name_index_t *ni, const grade_file_t *gf, uint64_t low, const char *prefix, size_t prefix_len)
+{
+    const char *name;
+    size_t len;
+    uint64_t high = ni->header.sorted_count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        name_of(gf, ni->entries[mid], &name, &len);
+        if (starts_with(name, len, prefix, prefix_len))
+        {
+            low = mid + 1;
+        } else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int name_search_prefix(const name_index_t *ni, const grade_file_t *gf, const char *prefix, size_t len,
+                       out_buffer_t *out, uint64_t *found)
+{
+    match_list_t run = { 0 }, tail = { 0 };
+    const char *name;
+    size_t name_len;
+    int result = 0;
+
+    *found = 0;
+    if (ni == NULL)
+    {
+        grade_record_t rec;
+        size_t cursor = 0;
+        while (result == 0 && grade_file_next(gf, &cursor, &rec))
+        {
+            if (starts_with(rec.name, rec.name_len, prefix, len))
+            {
+                (*found)++;
+                result = out_write(out, rec.line, rec.line_len) == -1 || out_write(out, "\n", 1) == -1 ? -1 : 0;
+            }
+        }
+        return result;
+    }
+
+    // Lower bound of the prefix, then every name that starts with it
+    uint64_t low = 0, high = ni->header.sorted_count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        name_of(gf, ni->entries[mid], &name, &name_len);
+        if (compare_names(name, name_len, prefix, len) < 0)
+        {
+            low = mid + 1;
+        } else
+        {
+            high = mid;
+        }
+    }
+    uint64_t end = prefix_end(ni, gf, low, prefix, len);
+    for (uint64_t i = low; i < end && result == 0; i++)
+    {
+        result = match_push(&run, ni->entries[i]);
+    }
+
+    for (uint64_t i = 0; i < ni->header.tail_count && result == 0; i++)
+    {
+        uint64_t entry = ni->entries[ni->header.sorted_count + i];
+        name_of(gf, entry, &name, &name_len);
+        if (starts_with(name, name_len, prefix, len))
+        {
+            result = match_push(&tail, entry);
+        }
+    }
+
+    if (result == 0)
+    {
+        *found = run.count + tail.count;
+        result = put_matches(gf, &run, &tail, out);
+    }
+    free(run.items);
+    free(tail.items);
+    return result;
+}
+
+// Extend the rows from depth `from` along name, recording in *computed how many rows hold
+// this name. Returns the depth at which every distance went over k, so that no name with
+// that prefix can match, or 0 after the whole name with *match set.
+static size_t fuzzy_extend(fuzzy_t *f, const char *name, size_t len, size_t from, size_t *computed, int *match)
+{
+    size_t width = f->m + 1;
+    for (size_t d = from; d < len; d++)
+    {
+        const unsigned *prev = f->rows + d * width;
+        unsigned *cur = f->rows + (d + 1) * width;
+        unsigned best = cur[0] = (unsigned)(d + 1);
+        for (size_t j = 1; j <= f->m; j++)
+        {
+            unsigned value = prev[j - 1] + (f->pattern[j - 1] != name[d]);
+            if (prev[j] + 1 < value)
+            {
+                value = prev[j] + 1;
+            }
+            if (cur[j - 1] + 1 < value)
+            {
+                value = cur[j - 1] + 1;
+            }
+            cur[j] = value;
+            if (value < best)
+            {
+                best = value;
+            }
+        }
+        *computed = d + 1;
+        // Rows never shrink below their minimum, and past depth m + k every cell exceeds k,
+        // so this also bounds how many rows are ever needed
+        if (best > f->k)
+        {
+            return d + 1;
+        }
+    }
+    *computed = len;
+    *match = f->rows[len * width + f->m] <= f->k;
+    return 0;
+}
+
+// Walk the sorted run as an implicit trie: consecutive names share the DP rows of their
+// common prefix, and once a prefix is out of reach every name under it is skipped at once
+int name_search_fuzzy(const name_index_t *ni, const grade_file_t *gf, const char *pattern, size_t len,
+                      unsigned max_distance, out_buffer_t *out, uint64_t *found)
+{
+    match_list_t run = { 0 }, tail = { 0 };
+    fuzzy_t f = { .pattern = pattern, .m = len, .k = max_distance };
+    const char *name;
+    size_t name_len, computed = 0;
+    int result = 0;
+
+    *found = 0;
+    if (len > NAME_SEARCH_MAX_LENGTH || max_distance > NAME_SEARCH_MAX_DISTANCE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    f.rows = malloc((len + max_distance + 2) * (len + 1) * sizeof(unsigned));
+    if (f.rows == NULL)
+    {
+        return -1;
+    }
+    for (size_t j = 0; j <= len; j++)
+    {
+        f.rows[j] = (unsigned)j;
+    }
+
+    if (ni == NULL)
+    {
+        grade_record_t rec;
+        size_t cursor = 0;
+        while (result == 0 && grade_file_next(gf, &cursor, &rec))
+        {
+            int match = 0;
+            if (length_within(rec.name_len, len, max_distance) &&
+                fuzzy_extend(&f, rec.name, rec.name_len, 0, &computed, &match) == 0 && match)
+            {
+                (*found)++;
+                result = out_write(out, rec.line, rec.line_len) == -1 || out_write(out, "\n", 1) == -1 ? -1 : 0;
+            }
+        }
+        free(f.rows);
+        return result;
+    }
+
+    const char *prev = "";
+    size_t prev_len = 0;
+    uint64_t i = 0;
+    while (i < ni->header.sorted_count && result == 0)
+    {
+        name_of(gf, ni->entries[i], &name, &name_len);
+        size_t common = 0;
+        while (common < name_len && common < prev_len && common < computed && name[common] == prev[common])
+        {
+            common++;
+        }
+
+        int match = 0;
+        size_t pruned = fuzzy_extend(&f, name, name_len, common, &computed, &match);
+        prev = name;
+        prev_len = name_len;
+        if (pruned > 0)
+        {
+            i = prefix_end(ni, gf, i + 1, name, pruned);
+            continue;
+        }
+        if (match)
+        {
+            result = match_push(&run, ni->entries[i]);
+        }
+        i++;
+    }
+
+    for (uint64_t t = 0; t < ni->header.tail_count && result == 0; t++)
+    {
+        uint64_t entry = ni->entries[ni->header.sorted_count + t];
+        int match = 0;
+        name_of(gf, entry, &name, &name_len);
+        if (length_within(name_len, len, max_distance) &&
+            fuzzy_extend(&f, name, name_len, 0, &computed, &match) == 0 && match)
+        {
+            result = match_push(&tail, entry);
+        }
+    }
+
+    if (result == 0)
+    {
+        *found = run.count + tail.count;
+        result = put_matches(gf, &run, &tail, out);
+    }
+    free(f.rows);
+    free(run.items);
+    free(tail.items);
+    return result;
+}
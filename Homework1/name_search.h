@@ -0,0 +1,19 @@
+#ifndef NAME_SEARCH_H
+#define NAME_SEARCH_H
+
+#include <stdint.h>
+#include "grade_file.h"
+#include "grade_index.h"
+#include "out_buffer.h"
+
+#define NAME_SEARCH_MAX_LENGTH 255 // longest fuzzy search pattern
+#define NAME_SEARCH_MAX_DISTANCE 8
+
+// Both searches print every matching line to out and count them in *found. With an index
+// the lines come in name order; with ni == NULL the file is scanned and they come in file order.
+int name_search_prefix(const name_index_t *ni, const grade_file_t *gf, const char *prefix, size_t len,
+                       out_buffer_t *out, uint64_t *found);
+int name_search_fuzzy(const name_index_t *ni, const grade_file_t *gf, const char *pattern, size_t len,
+                      unsigned max_distance, out_buffer_t *out, uint64_t *found);
+
+#endif
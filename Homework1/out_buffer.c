@@ -0,0 +1,103 @@
+#include "out_buffer.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+out_buffer_t stdout_buffer = { .fd = STDOUT_FILENO };
+unsigned long output_syscalls = 0;
+
+void out_init(out_buffer_t *ob, int fd)
+{
+    ob->fd = fd;
+    ob->len = 0;
+    ob->iov_count = 0;
+    ob->pending = 0;
+}
+
+int out_flush(out_buffer_t *ob)
+{
+    struct iovec *iov = ob->iov;
+    int count = ob->iov_count;
+
+    while (count > 0)
+    {
+        ssize_t written = count == 1 ? write(ob->fd, iov->iov_base, iov->iov_len) : writev(ob->fd, iov, count);
+        output_syscalls++;
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // Skip what went out and retry the rest after a short write
+        size_t done = (size_t)written;
+        while (count > 0 && done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    ob->len = 0;
+    ob->iov_count = 0;
+    ob->pending = 0;
+    return 0;
+}
+
+int out_write(out_buffer_t *ob, const void *data, size_t len)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+    if (len >= OUT_LARGE_WRITE)
+    {
+        if (ob->iov_count == OUT_IOV_MAX && out_flush(ob) == -1)
+        {
+            return -1;
+        }
+        ob->iov[ob->iov_count].iov_base = (void *)data;
+        ob->iov[ob->iov_count].iov_len = len;
+        ob->iov_count++;
+        ob->pending += len;
+        return ob->pending >= OUT_BUFFER_SIZE ? out_flush(ob) : 0;
+    }
+
+    if (ob->len + len > OUT_BUFFER_SIZE || ob->iov_count == OUT_IOV_MAX)
+    {
+        if (out_flush(ob) == -1)
+        {
+            return -1;
+        }
+    }
+
+    // Grow the last iovec when it already ends at the copy point
+    struct iovec *last = ob->iov_count > 0 ? &ob->iov[ob->iov_count - 1] : NULL;
+    if (last != NULL && (char *)last->iov_base + last->iov_len == ob->data + ob->len)
+    {
+        last->iov_len += len;
+    } else
+    {
+        ob->iov[ob->iov_count].iov_base = ob->data + ob->len;
+        ob->iov[ob->iov_count].iov_len = len;
+        ob->iov_count++;
+    }
+    memcpy(ob->data + ob->len, data, len);
+    ob->len += len;
+    ob->pending += len;
+    return ob->pending >= OUT_BUFFER_SIZE ? out_flush(ob) : 0;
+}
+
+int out_puts(out_buffer_t *ob, const char *str)
+{
+    return out_write(ob, str, strlen(str));
+}
@@ -0,0 +1,30 @@
+#ifndef OUT_BUFFER_H
+#define OUT_BUFFER_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define OUT_BUFFER_SIZE (64 * 1024)
+#define OUT_IOV_MAX 64
+#define OUT_LARGE_WRITE 4096 // chunks this big are queued by reference instead of copied
+
+// Output buffer flushed with writev once OUT_BUFFER_SIZE bytes are pending.
+// Large chunks are queued by reference, so they must stay valid until the next flush.
+typedef struct {
+    int fd;
+    char data[OUT_BUFFER_SIZE];
+    size_t len;       // bytes of data in use
+    struct iovec iov[OUT_IOV_MAX];
+    int iov_count;
+    size_t pending;   // bytes queued in iov
+} out_buffer_t;
+
+extern out_buffer_t stdout_buffer;
+extern unsigned long output_syscalls; // write/writev calls issued by every out_buffer_t
+
+void out_init(out_buffer_t *ob, int fd);
+int out_write(out_buffer_t *ob, const void *data, size_t len);
+int out_puts(out_buffer_t *ob, const char *str);
+int out_flush(out_buffer_t *ob);
+
+#endif
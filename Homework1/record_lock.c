@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "record_lock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+// Open file description locks belong to the open file rather than the process, so two
+// writers in one process exclude each other and closing another descriptor keeps them
+#ifdef F_OFD_SETLKW
+#define LOCK_WAIT F_OFD_SETLKW
+#define LOCK_TEST F_OFD_GETLK
+#else
+#define LOCK_WAIT F_SETLKW
+#define LOCK_TEST F_GETLK
+#endif
+
+// Take (F_WRLCK, F_RDLCK) or release (F_UNLCK) an advisory lock on [start, start + len),
+// waiting for conflicting locks to go away
+int record_lock(int fd, short type, off_t start, off_t len)
+{
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock)); // l_pid must be 0 for open file description locks
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = start;
+    lock.l_len = len;
+    while (fcntl(fd, LOCK_WAIT, &lock) == -1)
+    {
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Bytes of the first size bytes that hold finished appends. Every appender locks its range
+// before the file grows over it and unlocks it once the record-complete newline is written,
+// so the file is readable up to the start of the lowest locked range. Nothing blocks: a
+// lock test only reports the conflicting lock.
+size_t record_visible_size(int fd, size_t size)
+{
+    struct flock lock;
+    while (size > 0)
+    {
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_RDLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = 0;
+        lock.l_len = (off_t)size;
+        if (fcntl(fd, LOCK_TEST, &lock) == -1 || lock.l_type == F_UNLCK)
+        {
+            break;
+        }
+        if (lock.l_start >= (off_t)size)
+        {
+            break;
+        }
+        size = (size_t)lock.l_start; // ranges below it may still be in flight too
+    }
+    return size;
+}
@@ -0,0 +1,14 @@
+#ifndef RECORD_LOCK_H
+#define RECORD_LOCK_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Appenders to a shared grades file reserve their range while holding a write lock on this
+// byte. It lies far past any real end of file, so readers never see it as a write in flight.
+#define RECORD_RESERVE_BYTE ((off_t)1 << 62)
+
+int record_lock(int fd, short type, off_t start, off_t len);
+size_t record_visible_size(int fd, size_t size);
+
+#endif
@@ -0,0 +1,133 @@
+#include "byte_scan.h"
+#include "grade_file.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "bytes/cycle"
+#else
+#define BENCH_UNIT "bytes/ns"
+#endif
+
+#define BENCH_DEFAULT_REPEATS 5
+
+typedef size_t (*bench_fn)(const scan_kernels_t *k, const char *data, size_t len);
+
+// Time stamp counter cycles where there is one, nanoseconds otherwise
+static uint64_t now_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Line counting, as done to size a page or a line index
+static size_t bench_count(const scan_kernels_t *k, const char *data, size_t len)
+{
+    return k->count(data, len, '\n');
+}
+
+// Line splitting: one find per line, as grade_file_next does
+static size_t bench_split(const scan_kernels_t *k, const char *data, size_t len)
+{
+    size_t lines = 0, pos = 0;
+    while (pos < len)
+    {
+        const char *newline = k->find(data + pos, len - pos, '\n');
+        if (newline == NULL)
+        {
+            break;
+        }
+        pos = (size_t)(newline - data) + 1;
+        lines++;
+    }
+    return lines;
+}
+
+// Record parsing: the newline and then the last space of every line
+static size_t bench_parse(const scan_kernels_t *k, const char *data, size_t len)
+{
+    size_t records = 0, pos = 0;
+    while (pos < len)
+    {
+        const char *newline = k->find(data + pos, len - pos, '\n');
+        size_t line_len = newline != NULL ? (size_t)(newline - data) - pos : len - pos;
+        records += k->find_last(data + pos, line_len, ' ') != NULL;
+        pos += line_len + 1;
+    }
+    return records;
+}
+
+static const char *memchr_find(const char *data, size_t len, char c)
+{
+    return memchr(data, c, len);
+}
+
+// Best of repeats, in bytes per tick
+static double run(bench_fn fn, const scan_kernels_t *k, const grade_file_t *gf, int repeats, size_t *result)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < repeats; r++)
+    {
+        uint64_t start = now_ticks();
+        *result = fn(k, gf->data, gf->size);
+        uint64_t ticks = now_ticks() - start;
+        if (ticks < best)
+        {
+            best = ticks;
+        }
+    }
+    return best > 0 ? (double)gf->size / (double)best : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    grade_file_t gf;
+    size_t count = 0, result = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: scan_bench grades.txt [repeats]\n");
+        return EXIT_FAILURE;
+    }
+    int repeats = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : BENCH_DEFAULT_REPEATS;
+    if (grade_file_open(&gf, argv[1]) == -1 || gf.size == 0)
+    {
+        perror("Error opening file");
+        return EXIT_FAILURE;
+    }
+
+    // Fault the whole mapping in so the first kernel is not charged for it
+    volatile size_t warm = scan_count(gf.data, gf.size, '\n');
+    (void)warm;
+
+    printf("%s: %zu bytes, best of %d runs, %s\n", argv[1], gf.size, repeats, BENCH_UNIT);
+    printf("%-8s %10s %10s %10s\n", "kernels", "count", "split", "parse");
+
+    const scan_kernels_t *kernels = scan_available(&count);
+    for (size_t i = 0; i < count; i++)
+    {
+        double count_rate = run(bench_count, &kernels[i], &gf, repeats, &result);
+        size_t lines = result;
+        double split_rate = run(bench_split, &kernels[i], &gf, repeats, &result);
+        double parse_rate = run(bench_parse, &kernels[i], &gf, repeats, &result);
+        printf("%-8s %10.2f %10.2f %10.2f   (%zu lines)\n", kernels[i].name, count_rate, split_rate, parse_rate, lines);
+    }
+
+    // The C library memchr as the reference for line splitting
+    scan_kernels_t libc = *scan_active();
+    libc.name = "memchr";
+    libc.find = memchr_find;
+    printf("%-8s %10s %10.2f\n", libc.name, "-", run(bench_split, &libc, &gf, repeats, &result));
+
+    grade_file_close(&gf);
+    return EXIT_SUCCESS;
+}
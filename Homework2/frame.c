@@ -0,0 +1,91 @@
+#include "frame.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_READ_BUFFER (256 * 1024)
+
+int frame_write(channel_t *ch, uint32_t type, const void *payload, size_t length)
+{
+    frame_t frame;
+    if (length > FRAME_MAX_PAYLOAD)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    frame.type = type;
+    frame.length = (uint32_t)length;
+    memcpy(frame.payload, payload, length);
+    return channel_write(ch, &frame, FRAME_HEADER_SIZE + length);
+}
+
+int frame_reader_init(frame_reader_t *reader, channel_t *ch)
+{
+    reader->ch = ch;
+    reader->start = 0;
+    reader->end = 0;
+    reader->buffer = malloc(FRAME_READ_BUFFER);
+    return reader->buffer == NULL ? -1 : 0;
+}
+
+// Make sure at least len bytes are buffered. Returns 0 at EOF, when fewer bytes came.
+static int fill(frame_reader_t *reader, size_t len)
+{
+    if (reader->end - reader->start >= len)
+    {
+        return 1;
+    }
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+    while (reader->end < len)
+    {
+        ssize_t got = channel_read(reader->ch, reader->buffer + reader->end, FRAME_READ_BUFFER - reader->end);
+        if (got <= 0)
+        {
+            return (int)got;
+        }
+        reader->end += (size_t)got;
+    }
+    return 1;
+}
+
+// Read the next frame. Returns 1 for a frame, 0 at EOF between frames, and -1 on an error
+// or when the stream ends inside a frame (EPROTO).
+int frame_read(frame_reader_t *reader, frame_t *frame)
+{
+    int result = fill(reader, FRAME_HEADER_SIZE);
+    if (result <= 0)
+    {
+        if (result == 0 && reader->end > reader->start)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+        return result;
+    }
+    memcpy(frame, reader->buffer + reader->start, FRAME_HEADER_SIZE);
+    if (frame->length > FRAME_MAX_PAYLOAD)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    result = fill(reader, FRAME_HEADER_SIZE + frame->length);
+    if (result <= 0)
+    {
+        if (result == 0)
+        {
+            errno = EPROTO;
+        }
+        return -1;
+    }
+    memcpy(frame->payload, reader->buffer + reader->start + FRAME_HEADER_SIZE, frame->length);
+    reader->start += FRAME_HEADER_SIZE + frame->length;
+    return 1;
+}
+
+void frame_reader_free(frame_reader_t *reader)
+{
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <limits.h>
+#include <stdint.h>
+#include "transport.h"
+
+// Kinds of message on fifo2
+#define FRAME_NUMBERS 1   // a run of ints from the array
+#define FRAME_SUM 2       // the long long sum from child 1
+#define FRAME_COMMAND 3   // the command from the parent, without its terminator
+
+#define FRAME_HEADER_SIZE (2 * sizeof(uint32_t))
+#define FRAME_MAX_PAYLOAD (PIPE_BUF - FRAME_HEADER_SIZE)
+#define FRAME_MAX_NUMBERS (FRAME_MAX_PAYLOAD / sizeof(int))
+
+// A typed, length-prefixed message. A whole frame is at most PIPE_BUF bytes, so it is
+// written atomically and frames from several writers never interleave.
+typedef struct {
+    uint32_t type;
+    uint32_t length;   // payload bytes
+    char payload[FRAME_MAX_PAYLOAD];
+} frame_t;
+
+// Splits a channel back into frames, reading it in large blocks
+typedef struct {
+    channel_t *ch;
+    char *buffer;
+    size_t start;
+    size_t end;
+} frame_reader_t;
+
+int frame_write(channel_t *ch, uint32_t type, const void *payload, size_t length);
+int frame_reader_init(frame_reader_t *reader, channel_t *ch);
+int frame_read(frame_reader_t *reader, frame_t *frame);
+void frame_reader_free(frame_reader_t *reader);
+
+#endif
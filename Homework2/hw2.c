@@ -8,10 +8,33 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <stdint.h>
+#include "frame.h"
+#include "supervisor.h"
+#include "transport.h"
 
-#define ARRAY_SIZE 2
+#define CHUNK_INTS (64 * 1024)  // numbers per write and read, 256 KB
+#define PRINTED_NUMBERS 10      // longer arrays are only shown in part
 
-volatile sig_atomic_t child_exit_count = 0;
+// What a worker reduces its slice to: the sum, and the product wrapping around like child 2's
+typedef struct {
+    long long sum;
+    unsigned long long product;
+} partial_t;
+
+// The array is never held in memory as a whole: element i is derived from the seed, so the
+// parent generates it chunk by chunk while streaming it and the children consume it the same way
+long long array_size;
+uint64_t array_seed;
+
+// fifo1 carries the array to child 1. fifo2 carries frames to child 2: the array from the
+// parent, the sum from child 1 and the command from the parent, in whatever order they are
+// written. Both are named pipes or shared memory rings.
+channel_t channel1, channel2;
+
+// The parent keeps its end of fifo2 open until a child exits, so child 2 never sees EOF
+// between the parent's last frame and child 1 opening the FIFO
+int fifo2_held = 0;
 
 int safe_print(const char *message) 
 {
@@ -31,227 +54,506 @@ int safe_print(const char *message)
     return 0;  // Success
 }
 
-void sigchld_handler(int sig) 
+// Called by the supervisor as each child is reaped
+void report_child(const child_record_t *child) 
 {
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) 
+    char message[160];
+    if (WIFEXITED(child->status)) 
     {
-        safe_print("Signal handler invoked\n");
-        char message[100];
-        if (WIFEXITED(status)) 
-        {
-            snprintf(message, sizeof(message), "Child process %d exited with status: %d\n", pid, WEXITSTATUS(status));
-        } else 
-        {
-            if (errno == ECHILD) 
-            {
-                snprintf(message, sizeof(message), "No more child processes to wait for\n");
-            } else 
-            {
-                snprintf(message, sizeof(message), "Error waiting for child process: %s\n", strerror(errno));
-            }
-        }
-        safe_print(message);
-        child_exit_count++;
+        snprintf(message, sizeof(message), "Child process %d exited with status: %d\n", child->pid, WEXITSTATUS(child->status));
+    } else 
+    {
+        snprintf(message, sizeof(message), "Child process %d was killed by signal: %d\n", child->pid, WTERMSIG(child->status));
+    }
+    safe_print(message);
+    if (fifo2_held) 
+    {
+        channel_close(&channel2);
+        fifo2_held = 0;
     }
 }
 
-void create_fifos() 
+void create_fifos(transport_t transport) 
 {
-    char *fifo1 = "fifo1";
-    char *fifo2 = "fifo2";
-
-    if (mkfifo(fifo1, 0666) < 0 || mkfifo(fifo2, 0666) < 0) 
+    if (channel_create(&channel1, transport, "fifo1") < 0 || channel_create(&channel2, transport, "fifo2") < 0) 
     {
-        perror("Failed to create FIFOs");
+        perror(transport == TRANSPORT_SHM ? "Failed to create shared memory rings" : "Failed to create FIFOs");
         exit(EXIT_FAILURE);
     }
-    safe_print("FIFOs created successfully.\n");
+    safe_print(transport == TRANSPORT_SHM ? "Shared memory rings created successfully.\n" : "FIFOs created successfully.\n");
 }
 
-void generate_random_numbers(int numbers[]) 
+// splitmix64 of the element index, so any part of the array can be generated on its own
+int random_number_at(long long index) 
 {
-    srand(time(NULL));
-    for (int i = 0; i < ARRAY_SIZE; i++) 
+    uint64_t z = array_seed + (uint64_t)index * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (int)((z ^ (z >> 31)) % 100);
+}
+
+// Fill numbers with the count elements starting at first
+void generate_random_numbers(int numbers[], long long first, size_t count) 
+{
+    for (size_t i = 0; i < count; i++) 
     {
-        numbers[i] = rand() % 100; // Generate random numbers
+        numbers[i] = random_number_at(first + (long long)i);
     }
 }
 
-void write_to_fifo(int fd, int numbers[]) 
+void write_to_fifo(channel_t *ch, const int numbers[], size_t count) 
 {
-    for (int i = 0; i < ARRAY_SIZE; i++) 
+    if (channel_write(ch, numbers, count * sizeof(int)) == -1) 
     {
-        write(fd, &numbers[i], sizeof(int));
+        perror("Failed to write to FIFO");
+        exit(EXIT_FAILURE);
     }
 }
 
-void parent_process(int fd1, int fd2, int numbers[], int total_children) 
+// Send numbers as NUMBERS frames, each small enough to be written atomically
+void write_frames(channel_t *ch, const int numbers[], size_t count) 
 {
+    for (size_t i = 0; i < count; i += FRAME_MAX_NUMBERS) 
+    {
+        size_t n = count - i < FRAME_MAX_NUMBERS ? count - i : FRAME_MAX_NUMBERS;
+        if (frame_write(ch, FRAME_NUMBERS, numbers + i, n * sizeof(int)) == -1) 
+        {
+            perror("Failed to write to FIFO");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void parent_process(channel_t *ch1, channel_t *ch2, supervisor_t *sv) 
+{
+    int *chunk = malloc(CHUNK_INTS * sizeof(int));
+    if (chunk == NULL) 
+    {
+        perror("Failed to allocate chunk");
+        exit(EXIT_FAILURE);
+    }
+
     safe_print("Parent Process: Writing array to FIFO1 and command to FIFO2...\n");
-    write_to_fifo(fd1, numbers);
-    write_to_fifo(fd2, numbers);
-    close(fd1);
-    sleep(1); // Ensure children have enough time to read from the FIFOs before proceeding
-    char command[] = "multiply\0";  // Ensure it's null-terminated
-    write(fd2, command, strlen(command) + 1);  // Use strlen + 1 to include the null terminator
-    close(fd2);
-    
-    while (1) 
-    {
-        if (child_exit_count >= total_children) 
-        {  // Check if all child processes have exited
-            safe_print("All child processes have exited.\n");
-            break; // Exit the loop if all child processes have exited
+    for (long long first = 0; first < array_size; first += CHUNK_INTS) 
+    {
+        size_t count = array_size - first < CHUNK_INTS ? (size_t)(array_size - first) : CHUNK_INTS;
+        // Over splice, the chunk is built right in the pages that go to fifo1
+        int *numbers = channel_buffer(ch1, count * sizeof(int));
+        if (numbers == NULL) 
+        {
+            numbers = chunk;
         }
+        generate_random_numbers(numbers, first, count);
+        write_to_fifo(ch1, numbers, count);
+        write_frames(ch2, numbers, count);
+    }
+    free(chunk);
+    channel_close(ch1);
+    char command[] = "multiply";
+    if (frame_write(ch2, FRAME_COMMAND, command, strlen(command)) == -1) 
+    {
+        perror("Failed to write to FIFO");
+        exit(EXIT_FAILURE);
+    }
+    fifo2_held = 1;  // released by report_child
+
+    // Sleeps until the children exit instead of spinning on a counter
+    if (supervisor_wait_all(sv, report_child) == -1) 
+    {
+        perror("Failed to wait for child processes");
+        exit(EXIT_FAILURE);
     }
+    safe_print("All child processes have exited.\n");
 }
 
 void child_process1() 
 {
-    int fd1 = open("fifo1", O_RDONLY);
-    int num, sum = 0;
-    while (read(fd1, &num, sizeof(num)) > 0) 
+    int *chunk = malloc(CHUNK_INTS * sizeof(int));
+    if (chunk == NULL) 
     {
-        sum += num;
+        perror("Failed to allocate chunk");
+        exit(EXIT_FAILURE);
     }
+    if (channel_open(&channel1, O_RDONLY) == -1) 
+    {
+        perror("Failed to open FIFO1 for reading in Child Process 1");
+        exit(EXIT_FAILURE);
+    }
+    long long sum = 0;
+    ssize_t got;
+    while ((got = channel_read_full(&channel1, chunk, CHUNK_INTS * sizeof(int))) > 0) 
+    {
+        for (size_t i = 0; i < (size_t)got / sizeof(int); i++) 
+        {
+            sum += chunk[i];
+        }
+    }
+    free(chunk);
     char message[100];
-    snprintf(message, sizeof(message), "Child Process 1: Calculated sum: %d\n", sum);
+    snprintf(message, sizeof(message), "Child Process 1: Calculated sum: %lld\n", sum);
     safe_print(message);
-    close(fd1);
+    channel_close(&channel1);
 
-    int fd2 = open("fifo2", O_WRONLY | O_APPEND );
-    if (fd2 == -1) 
+    if (channel_open(&channel2, O_WRONLY | O_APPEND) == -1) 
     {
         perror("Failed to open FIFO2 for writing in Child Process 1");
         exit(EXIT_FAILURE);
     }
-    write(fd2, &sum, sizeof(sum));
+    if (frame_write(&channel2, FRAME_SUM, &sum, sizeof(sum)) == -1) 
+    {
+        perror("Failed to write to FIFO2 in Child Process 1");
+        exit(EXIT_FAILURE);
+    }
     safe_print("Child Process 1: wrote to fifo2\n");
-    close(fd2);
-    exit(sum);
+    channel_close(&channel2);
+    exit((int)sum);
 }
 
 void child_process2() 
 {
-    sleep(10);  // Ensure Child Process 1 has time to write the sum
-    int fd2 = open("fifo2", O_RDONLY);
-    int numbers[ARRAY_SIZE];
-    int sum_from_child1;
+    if (channel_open(&channel2, O_RDONLY) == -1) 
+    {
+        perror("Failed to open FIFO2 for reading in Child Process 2");
+        exit(EXIT_FAILURE);
+    }
+    frame_reader_t reader;
+    frame_t frame;
+    long long sum_from_child1 = 0;
+    long long received = 0;
+    int have_sum = 0, have_command = 0;
     char cmd_buffer[20] = {0};
-    int product = 1;
+    char message[100];
+    unsigned long long product = 1; // wraps around like the int product did, but without overflow
 
-    for (int i = 0; i < ARRAY_SIZE; i++) 
+    if (frame_reader_init(&reader, &channel2) == -1) 
+    {
+        perror("Failed to allocate frame buffer");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(message, sizeof(message), "Child Process 2: multiplying %lld numbers\n", array_size);
+    safe_print(message);
+    // Every part is recognised by its frame type, so they may arrive in any order
+    while (received < array_size || !have_sum || !have_command) 
     {
-        if (read(fd2, &numbers[i], sizeof(numbers[i])) > 0) 
+        int result = frame_read(&reader, &frame);
+        if (result <= 0) 
+        {
+            safe_print(result == 0 ? "Child Process 2: fifo2 closed before all parts arrived\n" : "Child Process 2: malformed data on fifo2\n");
+            break;
+        }
+        if (frame.type == FRAME_NUMBERS) 
+        {
+            const int *numbers = (const int *)frame.payload;
+            for (size_t i = 0; i < frame.length / sizeof(int); i++) 
+            {
+                product *= (unsigned long long)numbers[i];
+            }
+            received += (long long)(frame.length / sizeof(int));
+        } else if (frame.type == FRAME_SUM && frame.length == sizeof(sum_from_child1)) 
+        {
+            memcpy(&sum_from_child1, frame.payload, sizeof(sum_from_child1));
+            have_sum = 1;
+            snprintf(message, sizeof(message), "Child Process 2: Sum received: %lld\n", sum_from_child1);
+            safe_print(message);
+        } else if (frame.type == FRAME_COMMAND) 
+        {
+            size_t len = frame.length < sizeof(cmd_buffer) - 1 ? frame.length : sizeof(cmd_buffer) - 1;
+            memcpy(cmd_buffer, frame.payload, len);
+            cmd_buffer[len] = '\0';
+            have_command = 1;
+            snprintf(message, sizeof(message), "Child Process 2: Command received: %s\n", cmd_buffer);
+            safe_print(message);
+        } else 
         {
-            product *= numbers[i];
-            safe_print("Child Process 2: multiplying\n");
+            snprintf(message, sizeof(message), "Child Process 2: ignoring frame of type %u\n", frame.type);
+            safe_print(message);
         }
     }
+    frame_reader_free(&reader);
 
-    if (read(fd2, &sum_from_child1, sizeof(sum_from_child1)) > 0) 
+    if (received < array_size) 
     {
-        char message[100];
-        snprintf(message, sizeof(message), "Child Process 2: Sum received: %d\n", sum_from_child1);
-        safe_print(message);
+        safe_print("Child Process 2: array ended early\n");
     }
-
-    if (read(fd2, cmd_buffer, sizeof(cmd_buffer) - 1) > 0) 
+    if (have_sum && strcmp(cmd_buffer, "multiply") == 0) 
     {
-        char message[100];
-        snprintf(message, sizeof(message), "Child Process 2: Command received: %s\n", cmd_buffer);
+        long long final_sum = (long long)(product + (unsigned long long)sum_from_child1);  // Add the product to the sum received
+        snprintf(message, sizeof(message), "Child Process 2: Final sum after addition: %lld\n", final_sum);
         safe_print(message);
+    } else 
+    {
+        safe_print("Child Process 2: No valid command received.\n");
     }
 
-    if (strcmp(cmd_buffer, "multiply") == 0) 
+    channel_close(&channel2);
+    exit(0);
+}
+
+// Sum and multiply the count elements starting at first, a chunk at a time
+partial_t reduce_slice(long long first, long long count) 
+{
+    partial_t partial = { 0, 1 };
+    int *chunk = malloc(CHUNK_INTS * sizeof(int));
+    if (chunk == NULL) 
     {
-        int final_sum = product + sum_from_child1;  // Add the product to the sum received
-        char message[100];
-        snprintf(message, sizeof(message), "Child Process 2: Final sum after addition: %d\n", final_sum);
-        safe_print(message);
-    } else 
+        perror("Failed to allocate chunk");
+        exit(EXIT_FAILURE);
+    }
+    for (long long done = 0; done < count; ) 
     {
-        safe_print("Child Process 2: No valid command received.\n");
+        size_t n = count - done < CHUNK_INTS ? (size_t)(count - done) : CHUNK_INTS;
+        generate_random_numbers(chunk, first + done, n);
+        for (size_t i = 0; i < n; i++) 
+        {
+            partial.sum += chunk[i];
+            partial.product *= (unsigned long long)chunk[i];
+        }
+        done += (long long)n;
     }
+    free(chunk);
+    return partial;
+}
 
-    close(fd2);
+// Worker index of workers: reduce its own slice, then fold in the partials of the workers
+// below it in a binary tree. At each step a worker with bit step set hands its partial to
+// index - step over pipes[index] and is done; worker 0 ends up with everything and hands
+// it to the parent over pipes[0].
+void worker_process(int index, int workers, int pipes[][2]) 
+{
+    for (int i = 0; i < workers; i++) 
+    {
+        if (i != index) 
+        {
+            close(pipes[i][1]);
+        }
+    }
+    partial_t partial = reduce_slice(array_size * index / workers, array_size * (index + 1) / workers - array_size * index / workers);
+    for (int step = 1; step < workers && (index & step) == 0; step *= 2) 
+    {
+        if (index + step < workers) 
+        {
+            partial_t other;
+            if (read(pipes[index + step][0], &other, sizeof(other)) != (ssize_t)sizeof(other)) 
+            {
+                perror("Failed to read a partial result");
+                exit(EXIT_FAILURE);
+            }
+            partial.sum += other.sum;
+            partial.product *= other.product;
+        }
+    }
+    // A partial is far smaller than PIPE_BUF, so it arrives in one piece
+    if (write(pipes[index][1], &partial, sizeof(partial)) != (ssize_t)sizeof(partial)) 
+    {
+        perror("Failed to write a partial result");
+        exit(EXIT_FAILURE);
+    }
     exit(0);
 }
 
-int main(int argc, char *argv[]) 
+// Reduce the whole array with workers processes, returning the wall time in seconds
+double run_workers(int workers, partial_t *result) 
 {
-    if (argc != 2) 
+    int (*pipes)[2] = malloc(workers * sizeof(*pipes));
+    supervisor_t supervisor;
+    struct timespec start, end;
+
+    if (pipes == NULL || supervisor_init(&supervisor) == -1) 
     {
-        fprintf(stderr, "Usage: %s <integer>\n", argv[0]);
+        perror("Failed to set up the workers");
         exit(EXIT_FAILURE);
     }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < workers; i++) 
+    {
+        if (pipe(pipes[i]) == -1) 
+        {
+            perror("Failed to create a pipe");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < workers; i++) 
+    {
+        pid_t pid = fork();
+        if (pid == -1) 
+        {
+            perror("Failed to fork a worker");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) 
+        {
+            supervisor_child_init();
+            worker_process(i, workers, pipes);
+        }
+        supervisor_add(&supervisor, pid, "worker");
+    }
+    for (int i = 0; i < workers; i++) 
+    {
+        close(pipes[i][1]);
+    }
+    ssize_t got = read(pipes[0][0], result, sizeof(*result));
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-    int input = atoi(argv[1]);
-    char message[100];
-    snprintf(message, sizeof(message), "Received integer: %d\n", input);
+    if (supervisor_wait_all(&supervisor, NULL) == -1) 
+    {
+        perror("Failed to wait for the workers");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < supervisor.count; i++) 
+    {
+        const child_record_t *child = &supervisor.children[i];
+        if (!child->reaped || !WIFEXITED(child->status) || WEXITSTATUS(child->status) != 0) 
+        {
+            got = -1;
+        }
+    }
+    supervisor_close(&supervisor);
+    for (int i = 0; i < workers; i++) 
+    {
+        close(pipes[i][0]);
+    }
+    free(pipes);
+    if (got != (ssize_t)sizeof(*result)) 
+    {
+        fprintf(stderr, "A worker failed, no result from %d workers\n", workers);
+        exit(EXIT_FAILURE);
+    }
+    return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Time the reduction with 1, 2, 4, ... and finally max_workers workers
+void report_scaling(int max_workers) 
+{
+    char message[200];
+    partial_t result, first;
+    double base = 0;
+
+    snprintf(message, sizeof(message), "Tree reduction over %lld numbers with up to %d workers:\n", array_size, max_workers);
+    safe_print(message);
+    safe_print("workers    seconds    speedup\n");
+    for (int workers = 1; ; workers = workers * 2 < max_workers ? workers * 2 : max_workers) 
+    {
+        double seconds = run_workers(workers, &result);
+        if (workers == 1) 
+        {
+            base = seconds;
+            first = result;
+        } else if (result.sum != first.sum || result.product != first.product) 
+        {
+            fprintf(stderr, "%d workers disagree with 1 worker\n", workers);
+            exit(EXIT_FAILURE);
+        }
+        snprintf(message, sizeof(message), "%7d %10.3f %9.2fx\n", workers, seconds, base / seconds);
+        safe_print(message);
+        if (workers == max_workers) 
+        {
+            break;
+        }
+    }
+    snprintf(message, sizeof(message), "Sum: %lld\nFinal sum after addition: %lld\n", result.sum, (long long)(result.product + (unsigned long long)result.sum));
     safe_print(message);
+}
 
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
+int main(int argc, char *argv[]) 
+{
+    transport_t transport = TRANSPORT_FIFO;
+    int workers = 0; // the two fixed children unless --workers is given
+    int valid = argc >= 2;
+    for (int i = 2; valid && i < argc; i++) 
+    {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) 
+        {
+            valid = parse_transport(argv[++i], &transport) == 0;
+        } else if (strcmp(argv[i], "--workers") == 0) 
+        {
+            // The count is optional and defaults to one worker per core
+            workers = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+            valid = workers > 0;
+        } else 
+        {
+            valid = 0;
+        }
+    }
+    // The integer is the size of the array
+    array_size = valid ? atoll(argv[1]) : 0;
+    if (array_size <= 0) 
+    {
+        fprintf(stderr, "Usage: %s <array size> [--transport fifo|shm|splice] [--workers [N]]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
-    create_fifos();
+    char message[200];
+    snprintf(message, sizeof(message), "Received integer: %lld\n", array_size);
+    safe_print(message);
 
-    int numbers[ARRAY_SIZE];
-    generate_random_numbers(numbers);
+    array_seed = (uint64_t)time(NULL) * 0x9e3779b97f4a7c15ULL ^ (uint64_t)getpid();
     safe_print("Array filled with random numbers:\n");
-    for (int i = 0; i < ARRAY_SIZE; i++) {
-        snprintf(message, sizeof(message), "%d ", numbers[i]);
+    for (long long i = 0; i < array_size && i < PRINTED_NUMBERS; i++) {
+        snprintf(message, sizeof(message), "%d ", random_number_at(i));
+        safe_print(message);
+    }
+    if (array_size > PRINTED_NUMBERS) 
+    {
+        snprintf(message, sizeof(message), "... (%lld numbers)", array_size);
         safe_print(message);
     }
     safe_print("\n");
 
+    if (workers > 0) 
+    {  // Fan out across the workers instead of the two fixed children
+        report_scaling(workers);
+        return EXIT_SUCCESS;
+    }
+
+    // SIGCHLD is blocked from here on and only read through the supervisor's signalfd
+    supervisor_t supervisor;
+    if (supervisor_init(&supervisor) == -1) 
+    {
+        perror("Failed to set up the child supervisor");
+        exit(EXIT_FAILURE);
+    }
+
+    create_fifos(transport);
+
     pid_t pid1 = fork();
     if (pid1 == 0) 
     {  // Child Process 1
+        supervisor_child_init();
         child_process1();
     }
+    supervisor_add(&supervisor, pid1, "child 1");
 
     pid_t pid2 = fork();
     if (pid2 == 0) 
     {  // Child Process 2
+        supervisor_child_init();
         child_process2();
     }
+    supervisor_add(&supervisor, pid2, "child 2");
 
-    int fd1 = open("fifo1", O_WRONLY);
-    int fd2 = open("fifo2", O_WRONLY | O_APPEND);
-    if (fd1 == -1 || fd2 == -1) 
+    if (channel_open(&channel1, O_WRONLY) == -1 || channel_open(&channel2, O_WRONLY | O_APPEND) == -1) 
     {
         perror("Failed to open FIFOs");
         exit(EXIT_FAILURE);
     }
 
-    parent_process(fd1, fd2, numbers, 2); // Total number of children processes is 2
+    parent_process(&channel1, &channel2, &supervisor);
 
     safe_print("Exit statuses of all processes:\n");
-    int status;
-    while (wait(&status) > 0) 
+    for (size_t i = 0; i < supervisor.count; i++) 
     {
-        if (WIFEXITED(status)) 
-        {
-            snprintf(message, sizeof(message), "Child process %d exited with status: %d\n", pid1, WEXITSTATUS(status));
-        } else 
-        {
-            if (errno == ECHILD) 
-            {
-                snprintf(message, sizeof(message), "No more child processes to wait for\n");
-            } else 
-            {
-                snprintf(message, sizeof(message), "Error waiting for child process: %s\n", strerror(errno));
-            }
-        }
+        const child_record_t *child = &supervisor.children[i];
+        int code = WIFEXITED(child->status) ? WEXITSTATUS(child->status) : -WTERMSIG(child->status);
+        snprintf(message, sizeof(message), "%s (pid %d): status %d, %.3f s wall, %.3f s user, %.3f s sys, %ld KB max RSS\n",
+                 child->name, child->pid, code, child_seconds(child),
+                 child->usage.ru_utime.tv_sec + child->usage.ru_utime.tv_usec / 1e6,
+                 child->usage.ru_stime.tv_sec + child->usage.ru_stime.tv_usec / 1e6, child->usage.ru_maxrss);
         safe_print(message);
     }
+    supervisor_close(&supervisor);
 
+    channel_remove(&channel1);
+    channel_remove(&channel2);
     safe_print("Parent Process: Exiting.\n");
     return EXIT_SUCCESS;
 }
\ No newline at end of file
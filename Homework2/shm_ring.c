@@ -0,0 +1,282 @@
+#include "shm_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define PEER_CHECK_MS 100 // a wait this long without progress looks for dead peers
+
+// The ring is shared between processes, so these are not FUTEX_PRIVATE_FLAG operations.
+// Returns 1 when PEER_CHECK_MS went by without a wake-up.
+static int futex_wait(uint32_t *word, uint32_t expected)
+{
+    struct timespec timeout = { 0, PEER_CHECK_MS * 1000000L };
+    return syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0) == -1 && errno == ETIMEDOUT;
+}
+
+static void futex_wake(uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Whether process pid has exited. kill(pid, 0) still finds a child that exited but was not
+// reaped, and a parent stuck on the ring cannot reap it, so the exit is read off a pidfd.
+static int peer_gone(pid_t pid)
+{
+    int saved = errno;
+    int gone;
+#ifdef SYS_pidfd_open
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd != -1)
+    {
+        struct pollfd exited = { fd, POLLIN, 0 };
+        gone = poll(&exited, 1, 0) == 1;
+        close(fd);
+        errno = saved;
+        return gone;
+    }
+    if (errno != ENOSYS)
+    {
+        gone = errno == ESRCH;
+        errno = saved;
+        return gone;
+    }
+#endif
+    gone = kill(pid, 0) == -1 && errno == ESRCH;
+    errno = saved;
+    return gone;
+}
+
+// Mutex with the usual three states, so an uncontended lock and unlock make no system call.
+// Fails with EPIPE when the producer holding it died, cutting its write short.
+static int ring_lock(shm_ring_t *ring)
+{
+    uint32_t state = 0;
+    if (!__atomic_compare_exchange_n(&ring->lock, &state, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        if (state != 2)
+        {
+            state = __atomic_exchange_n(&ring->lock, 2, __ATOMIC_ACQUIRE);
+        }
+        while (state != 0)
+        {
+            if (futex_wait(&ring->lock, 2))
+            {
+                pid_t owner = __atomic_load_n(&ring->lock_owner, __ATOMIC_SEQ_CST);
+                if (owner != 0 && peer_gone(owner))
+                {
+                    errno = EPIPE;
+                    return -1;
+                }
+            }
+            state = __atomic_exchange_n(&ring->lock, 2, __ATOMIC_ACQUIRE);
+        }
+    }
+    __atomic_store_n(&ring->lock_owner, getpid(), __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static void ring_unlock(shm_ring_t *ring)
+{
+    __atomic_store_n(&ring->lock_owner, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_fetch_sub(&ring->lock, 1, __ATOMIC_RELEASE) != 1)
+    {
+        __atomic_store_n(&ring->lock, 0, __ATOMIC_RELEASE);
+        futex_wake(&ring->lock, 1);
+    }
+}
+
+// Announce a sleeper, then sleep unless seq moved past seen meanwhile. The other side bumps
+// seq before it looks at waiting, so one of the two always notices the other. Returns 1
+// when the sleep timed out, the cue to check that the other side is still there.
+static int ring_sleep(uint32_t *seq, uint32_t *waiting, uint32_t seen)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(seq, __ATOMIC_SEQ_CST) == seen)
+    {
+        return futex_wait(seq, seen);
+    }
+    return 0;
+}
+
+static void ring_signal(uint32_t *seq, uint32_t *waiting)
+{
+    __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST) != 0)
+    {
+        futex_wake(seq, 1);
+    }
+}
+
+// Create a ring under name and map it. The name is removed again right away: the
+// processes sharing the ring are forked afterwards and inherit the mapping.
+shm_ring_t *shm_ring_create(const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(shm_ring_t)) == 0)
+    {
+        map = mmap(NULL, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    }
+    int saved = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = saved;
+    return map == MAP_FAILED ? NULL : map; // a new shared memory object reads as zeros
+}
+
+void shm_ring_destroy(shm_ring_t *ring)
+{
+    munmap(ring, sizeof(shm_ring_t));
+}
+
+void shm_ring_open_reader(shm_ring_t *ring)
+{
+    __atomic_store_n(&ring->reader_pid, getpid(), __ATOMIC_SEQ_CST);
+}
+
+// Producers beyond SHM_RING_WRITER_SLOTS still count, the consumer just cannot tell when they die
+void shm_ring_open_writer(shm_ring_t *ring)
+{
+    pid_t self = getpid();
+    __atomic_fetch_add(&ring->writers, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < SHM_RING_WRITER_SLOTS; i++)
+    {
+        pid_t free_slot = 0;
+        if (__atomic_compare_exchange_n(&ring->writer_pids[i], &free_slot, self, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            break;
+        }
+    }
+    __atomic_store_n(&ring->opened, 1, __ATOMIC_SEQ_CST);
+}
+
+// The last writer to close ends the stream once the consumer has drained it
+void shm_ring_close_writer(shm_ring_t *ring)
+{
+    pid_t self = getpid();
+    for (int i = 0; i < SHM_RING_WRITER_SLOTS; i++)
+    {
+        pid_t slot = self;
+        if (__atomic_compare_exchange_n(&ring->writer_pids[i], &slot, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            break;
+        }
+    }
+    __atomic_fetch_sub(&ring->writers, 1, __ATOMIC_SEQ_CST);
+    ring_signal(&ring->data_seq, &ring->consumer_waiting);
+}
+
+void shm_ring_close_reader(shm_ring_t *ring)
+{
+    __atomic_store_n(&ring->reader_closed, 1, __ATOMIC_SEQ_CST);
+    ring_signal(&ring->space_seq, &ring->producer_waiting);
+}
+
+// Close the ring for producers that died with it open, which may make it EOF
+static void reap_writers(shm_ring_t *ring)
+{
+    for (int i = 0; i < SHM_RING_WRITER_SLOTS; i++)
+    {
+        pid_t pid = __atomic_load_n(&ring->writer_pids[i], __ATOMIC_SEQ_CST);
+        if (pid != 0 && peer_gone(pid) &&
+            __atomic_compare_exchange_n(&ring->writer_pids[i], &pid, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            __atomic_fetch_sub(&ring->writers, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+}
+
+// Copy all of data into the ring, waiting for the consumer whenever it is full
+int shm_ring_write(shm_ring_t *ring, const void *data, size_t len)
+{
+    const char *from = data;
+    if (ring_lock(ring) == -1)
+    {
+        return -1;
+    }
+    while (len > 0)
+    {
+        uint32_t seen = __atomic_load_n(&ring->space_seq, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->reader_closed, __ATOMIC_SEQ_CST))
+        {
+            ring_unlock(ring);
+            errno = EPIPE;
+            return -1;
+        }
+        uint64_t head = ring->head; // only changed under the lock
+        size_t space = SHM_RING_CAPACITY - (size_t)(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+        if (space == 0)
+        {
+            // A consumer that died never drains the ring: treat it as closed, as a FIFO would
+            if (ring_sleep(&ring->space_seq, &ring->producer_waiting, seen))
+            {
+                pid_t reader = __atomic_load_n(&ring->reader_pid, __ATOMIC_SEQ_CST);
+                if (reader != 0 && peer_gone(reader))
+                {
+                    __atomic_store_n(&ring->reader_closed, 1, __ATOMIC_SEQ_CST);
+                }
+            }
+            continue;
+        }
+
+        size_t n = len < space ? len : space;
+        size_t offset = (size_t)head & (SHM_RING_CAPACITY - 1);
+        size_t first = n < SHM_RING_CAPACITY - offset ? n : SHM_RING_CAPACITY - offset;
+        memcpy(ring->data + offset, from, first);
+        memcpy(ring->data, from + first, n - first);
+        __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+        ring_signal(&ring->data_seq, &ring->consumer_waiting);
+        from += n;
+        len -= n;
+    }
+    ring_unlock(ring);
+    return 0;
+}
+
+// Copy up to len bytes out of the ring, waiting while it is empty. Returns 0 at EOF: the
+// ring is empty, and every writer that opened it has closed it or died.
+size_t shm_ring_read(shm_ring_t *ring, void *data, size_t len)
+{
+    uint64_t tail = ring->tail; // only changed by the consumer
+    uint64_t head;
+    for (;;)
+    {
+        uint32_t seen = __atomic_load_n(&ring->data_seq, __ATOMIC_SEQ_CST);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head != tail || len == 0)
+        {
+            break;
+        }
+        // A writer moves head before it closes, so head is looked at again once they are gone
+        if (__atomic_load_n(&ring->opened, __ATOMIC_SEQ_CST) && __atomic_load_n(&ring->writers, __ATOMIC_SEQ_CST) == 0 &&
+            __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+        {
+            return 0;
+        }
+        if (ring_sleep(&ring->data_seq, &ring->consumer_waiting, seen))
+        {
+            reap_writers(ring);
+        }
+    }
+
+    size_t available = (size_t)(head - tail);
+    size_t n = len < available ? len : available;
+    size_t offset = (size_t)tail & (SHM_RING_CAPACITY - 1);
+    size_t first = n < SHM_RING_CAPACITY - offset ? n : SHM_RING_CAPACITY - offset;
+    memcpy(data, ring->data + offset, first);
+    memcpy((char *)data + first, ring->data, n - first);
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+    ring_signal(&ring->space_seq, &ring->producer_waiting);
+    return n;
+}
@@ -0,0 +1,44 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_RING_CAPACITY (1 << 20) // data bytes, a power of two
+#define SHM_RING_WRITER_SLOTS 8     // producers whose exit the consumer notices
+
+// Byte stream between processes through a shared mapping, used in place of a FIFO.
+// Producers take turns under a futex lock, so a write is never interleaved with another
+// one, and the single consumer needs no lock at all. A side that has to wait sleeps on a
+// futex, and the other side only makes the wake-up system call when someone is asleep.
+// Nothing closes a ring when a process dies, so a wait that sees no progress for a while
+// looks up the peers' pids: a dead consumer fails writes with EPIPE, and dead producers
+// count as closed.
+typedef struct {
+    uint64_t head;              // bytes written so far
+    uint64_t tail;              // bytes read so far
+    uint32_t data_seq;          // bumped after every write and close, the consumer sleeps on it
+    uint32_t space_seq;         // bumped after every read, producers sleep on it
+    uint32_t consumer_waiting;
+    uint32_t producer_waiting;
+    uint32_t lock;              // 0 free, 1 taken, 2 taken with waiters
+    uint32_t writers;           // producers with the ring open
+    uint32_t opened;            // a producer came along, so an empty ring without writers is EOF
+    uint32_t reader_closed;     // writes fail with EPIPE, as on a FIFO without readers
+    pid_t reader_pid;           // 0 until the consumer opens the ring
+    pid_t lock_owner;           // producer holding lock, 0 when free or not known yet
+    pid_t writer_pids[SHM_RING_WRITER_SLOTS]; // producers with the ring open, 0 for a free slot
+    char data[SHM_RING_CAPACITY];
+} shm_ring_t;
+
+shm_ring_t *shm_ring_create(const char *name);
+void shm_ring_destroy(shm_ring_t *ring);
+void shm_ring_open_reader(shm_ring_t *ring);
+void shm_ring_open_writer(shm_ring_t *ring);
+void shm_ring_close_writer(shm_ring_t *ring);
+void shm_ring_close_reader(shm_ring_t *ring);
+int shm_ring_write(shm_ring_t *ring, const void *data, size_t len);
+size_t shm_ring_read(shm_ring_t *ring, void *data, size_t len);
+
+#endif
@@ -0,0 +1,181 @@
+#include "supervisor.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+// Block SIGCHLD and watch for it through a signalfd. Call before forking, so no exit can
+// slip by between the fork and the first wait.
+int supervisor_init(supervisor_t *sv)
+{
+    sigset_t mask;
+    struct epoll_event event = { .events = EPOLLIN };
+
+    sv->children = NULL;
+    sv->count = 0;
+    sv->capacity = 0;
+    sv->running = 0;
+    sv->epoll_fd = -1;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+    {
+        return -1;
+    }
+    sv->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sv->signal_fd == -1)
+    {
+        return -1;
+    }
+    sv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event.data.fd = sv->signal_fd;
+    if (sv->epoll_fd == -1 || epoll_ctl(sv->epoll_fd, EPOLL_CTL_ADD, sv->signal_fd, &event) == -1)
+    {
+        supervisor_close(sv);
+        return -1;
+    }
+    return 0;
+}
+
+// A forked child does not supervise anything, so it gets SIGCHLD back
+void supervisor_child_init(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+// Start keeping track of a child right after forking it
+int supervisor_add(supervisor_t *sv, pid_t pid, const char *name)
+{
+    if (sv->count == sv->capacity)
+    {
+        size_t capacity = sv->capacity > 0 ? sv->capacity * 2 : 8;
+        child_record_t *children = realloc(sv->children, capacity * sizeof(child_record_t));
+        if (children == NULL)
+        {
+            return -1;
+        }
+        sv->children = children;
+        sv->capacity = capacity;
+    }
+    child_record_t *child = &sv->children[sv->count++];
+    child->pid = pid;
+    child->name = name;
+    clock_gettime(CLOCK_MONOTONIC, &child->started);
+    child->reaped = 0;
+    sv->running++;
+    return 0;
+}
+
+static child_record_t *find_child(supervisor_t *sv, pid_t pid)
+{
+    for (size_t i = 0; i < sv->count; i++)
+    {
+        if (sv->children[i].pid == pid && !sv->children[i].reaped)
+        {
+            return &sv->children[i];
+        }
+    }
+    return NULL;
+}
+
+// Reap every child that has exited. Several exits may share one SIGCHLD. Fails with
+// ECHILD when children are still expected but none are left: they were reaped elsewhere.
+static int reap(supervisor_t *sv, void (*on_exit)(const child_record_t *child))
+{
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    for (;;)
+    {
+        pid = wait4(-1, &status, WNOHANG, &usage);
+        if (pid == 0)
+        {
+            return 0; // no other child has exited yet
+        }
+        if (pid == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == ECHILD && sv->running == 0 ? 0 : -1;
+        }
+        child_record_t *child = find_child(sv, pid);
+        if (child == NULL)
+        {
+            continue; // not forked through the supervisor
+        }
+        clock_gettime(CLOCK_MONOTONIC, &child->ended);
+        child->status = status;
+        child->usage = usage;
+        child->reaped = 1;
+        sv->running--;
+        if (on_exit != NULL)
+        {
+            on_exit(child);
+        }
+    }
+}
+
+// Sleep in epoll_wait until every added child has exited, calling on_exit for each one
+int supervisor_wait_all(supervisor_t *sv, void (*on_exit)(const child_record_t *child))
+{
+    struct epoll_event event;
+    struct signalfd_siginfo info;
+
+    // Exits that came before the first wait
+    if (reap(sv, on_exit) == -1)
+    {
+        return -1;
+    }
+    while (sv->running > 0)
+    {
+        int ready = epoll_wait(sv->epoll_fd, &event, 1, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        while (read(sv->signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+        {
+            // drained: the signals only say that something exited
+        }
+        if (reap(sv, on_exit) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void supervisor_close(supervisor_t *sv)
+{
+    sigset_t mask;
+    if (sv->epoll_fd != -1)
+    {
+        close(sv->epoll_fd);
+    }
+    if (sv->signal_fd != -1)
+    {
+        close(sv->signal_fd);
+    }
+    free(sv->children);
+    sv->children = NULL;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+double child_seconds(const child_record_t *child)
+{
+    return (double)(child->ended.tv_sec - child->started.tv_sec) + (double)(child->ended.tv_nsec - child->started.tv_nsec) / 1e9;
+}
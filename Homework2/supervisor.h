@@ -0,0 +1,38 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stddef.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+// What became of one forked child
+typedef struct {
+    pid_t pid;
+    const char *name;
+    struct timespec started;
+    struct timespec ended;
+    int status;            // as returned by wait4
+    struct rusage usage;   // of the child alone
+    int reaped;
+} child_record_t;
+
+// Reaps children from a signalfd watched by epoll, so waiting for them uses no CPU at all.
+// SIGCHLD stays blocked while the supervisor exists: it is only ever read from the signalfd.
+typedef struct {
+    int signal_fd;
+    int epoll_fd;
+    child_record_t *children;
+    size_t count;
+    size_t capacity;
+    size_t running;
+} supervisor_t;
+
+int supervisor_init(supervisor_t *sv);
+void supervisor_child_init(void);
+int supervisor_add(supervisor_t *sv, pid_t pid, const char *name);
+int supervisor_wait_all(supervisor_t *sv, void (*on_exit)(const child_record_t *child));
+void supervisor_close(supervisor_t *sv);
+double child_seconds(const child_record_t *child);
+
+#endif
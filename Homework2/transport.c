@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+#include "transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+int parse_transport(const char *text, transport_t *kind)
+{
+    if (strcmp(text, "fifo") == 0)
+    {
+        *kind = TRANSPORT_FIFO;
+    } else if (strcmp(text, "shm") == 0)
+    {
+        *kind = TRANSPORT_SHM;
+    } else if (strcmp(text, "splice") == 0)
+    {
+        *kind = TRANSPORT_SPLICE;
+    } else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+const char *transport_name(transport_t kind)
+{
+    return kind == TRANSPORT_SHM ? "shm" : kind == TRANSPORT_SPLICE ? "splice" : "fifo";
+}
+
+// Make the FIFO, or the ring, that name stands for
+int channel_create(channel_t *ch, transport_t kind, const char *name)
+{
+    ch->kind = kind;
+    ch->name = name;
+    ch->fd = -1;
+    ch->ring = NULL;
+    ch->writing = 0;
+    ch->pages = NULL;
+    ch->pages_size = 0;
+    ch->pages_next = 0;
+    if (kind != TRANSPORT_SHM)
+    {
+        return mkfifo(name, 0666);
+    }
+
+    char shm_name[64];
+    snprintf(shm_name, sizeof(shm_name), "/ipc.%d.%s", (int)getpid(), name);
+    ch->ring = shm_ring_create(shm_name);
+    return ch->ring != NULL ? 0 : -1;
+}
+
+// Open this process's end. A FIFO open blocks until the other side opens it too; a ring
+// reader instead waits in its first read until a writer has come along.
+int channel_open(channel_t *ch, int flags)
+{
+    if (ch->kind != TRANSPORT_SHM)
+    {
+        ch->fd = open(ch->name, flags);
+        if (ch->fd == -1)
+        {
+            return -1;
+        }
+        // A larger pipe takes several chunks before the writer has to wait; keep the default if refused
+        fcntl(ch->fd, F_SETPIPE_SZ, CHANNEL_PIPE_SIZE);
+        return 0;
+    }
+    ch->writing = (flags & O_ACCMODE) != O_RDONLY;
+    if (ch->writing)
+    {
+        shm_ring_open_writer(ch->ring);
+    } else
+    {
+        shm_ring_open_reader(ch->ring);
+    }
+    return 0;
+}
+
+// vmsplice only lends pages to the pipe, so a page must not change until the reader has
+// copied it out. The pipe never holds more than its capacity, so pages twice that size,
+// handed out at most a quarter at a time, are always drained by the time they come around.
+// Either end may resize the pipe after the pages are mapped, so they are sized for the
+// largest pipe a channel asks for, and channel_buffer checks the capacity on every use.
+static int map_pages(channel_t *ch)
+{
+    if (ch->pages != NULL)
+    {
+        return 0;
+    }
+    int capacity = fcntl(ch->fd, F_GETPIPE_SZ);
+    if (capacity <= 0)
+    {
+        return -1;
+    }
+    size_t size = 2 * ((size_t)capacity > CHANNEL_PIPE_SIZE ? (size_t)capacity : CHANNEL_PIPE_SIZE);
+    void *pages = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (pages == MAP_FAILED)
+    {
+        return -1;
+    }
+    ch->pages = pages;
+    ch->pages_size = size;
+    ch->pages_next = 0;
+    return 0;
+}
+
+// Memory to build the next write of up to len bytes in. A splice writer hands out its own
+// pages, so writing them back costs no copy at all; NULL means use any buffer, as does a
+// pipe grown past what the pages cover.
+void *channel_buffer(channel_t *ch, size_t len)
+{
+    if (ch->kind != TRANSPORT_SPLICE || len < CHANNEL_SPLICE_MIN || map_pages(ch) == -1 || len > ch->pages_size / 4)
+    {
+        return NULL;
+    }
+    int capacity = fcntl(ch->fd, F_GETPIPE_SZ);
+    if (capacity <= 0 || (size_t)capacity > ch->pages_size / 2)
+    {
+        return NULL;
+    }
+    if (ch->pages_next + len > ch->pages_size)
+    {
+        ch->pages_next = 0;
+    }
+    return ch->pages + ch->pages_next;
+}
+
+static int write_all(int fd, const char *from, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write(fd, from, len);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        from += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+// Give the pages holding data to the pipe, copying data into them first unless it was
+// built there through channel_buffer. Once the pages are refused, the rest goes through write().
+static int splice_write(channel_t *ch, const char *from, size_t len)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    while (len > 0)
+    {
+        size_t n = len < ch->pages_size / 4 ? len : ch->pages_size / 4;
+        char *pages = channel_buffer(ch, n < CHANNEL_SPLICE_MIN ? CHANNEL_SPLICE_MIN : n);
+        if (pages == NULL)
+        {
+            return write_all(ch->fd, from, len);
+        }
+        if (from != pages)
+        {
+            memcpy(pages, from, n);
+        }
+        struct iovec iov = { pages, n };
+        while (iov.iov_len > 0)
+        {
+            ssize_t spliced = vmsplice(ch->fd, &iov, 1, SPLICE_F_GIFT);
+            if (spliced == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return -1;
+            }
+            iov.iov_base = (char *)iov.iov_base + spliced;
+            iov.iov_len -= (size_t)spliced;
+        }
+        ch->pages_next = ((size_t)(pages - ch->pages) + n + page - 1) / page * page;
+        from += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Write all of data
+int channel_write(channel_t *ch, const void *data, size_t len)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        return shm_ring_write(ch->ring, data, len);
+    }
+    if (ch->kind == TRANSPORT_SPLICE && len >= CHANNEL_SPLICE_MIN && map_pages(ch) == 0)
+    {
+        return splice_write(ch, data, len);
+    }
+    return write_all(ch->fd, data, len);
+}
+
+// Read what is there, up to len bytes. Returns 0 at EOF.
+ssize_t channel_read(channel_t *ch, void *data, size_t len)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        return (ssize_t)shm_ring_read(ch->ring, data, len);
+    }
+    ssize_t got;
+    do
+    {
+        got = read(ch->fd, data, len);
+    } while (got == -1 && errno == EINTR);
+    return got;
+}
+
+// Read exactly len bytes, or fewer when the stream ends first
+ssize_t channel_read_full(channel_t *ch, void *data, size_t len)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        ssize_t got = channel_read(ch, (char *)data + total, len - total);
+        if (got == -1)
+        {
+            return -1;
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        total += (size_t)got;
+    }
+    return (ssize_t)total;
+}
+
+int channel_close(channel_t *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        if (ch->writing)
+        {
+            shm_ring_close_writer(ch->ring);
+        } else
+        {
+            shm_ring_close_reader(ch->ring);
+        }
+        ch->writing = 0;
+        return 0;
+    }
+    int result = ch->fd != -1 ? close(ch->fd) : 0;
+    ch->fd = -1;
+    if (ch->pages != NULL)
+    {
+        munmap(ch->pages, ch->pages_size); // the pipe keeps its own references to what it still holds
+        ch->pages = NULL;
+    }
+    return result;
+}
+
+// Remove the FIFO from the directory, or unmap the ring, once no process needs it anymore
+void channel_remove(channel_t *ch)
+{
+    if (ch->kind != TRANSPORT_SHM)
+    {
+        unlink(ch->name);
+    } else if (ch->ring != NULL)
+    {
+        shm_ring_destroy(ch->ring);
+        ch->ring = NULL;
+    }
+}
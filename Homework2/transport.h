@@ -0,0 +1,43 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "shm_ring.h"
+
+#define CHANNEL_PIPE_SIZE (1 << 20) // FIFO buffer, the size of a ring
+#define CHANNEL_SPLICE_MIN (64 * 1024) // smaller splice writes, such as frames, use write()
+
+// How the processes exchange data: named pipes, rings in shared memory, or named pipes
+// that large writes reach through vmsplice instead of write
+typedef enum {
+    TRANSPORT_FIFO,
+    TRANSPORT_SHM,
+    TRANSPORT_SPLICE
+} transport_t;
+
+// One named stream, such as fifo1. It is created before forking and every process opens
+// its own end, the way a FIFO is opened by name.
+typedef struct {
+    transport_t kind;
+    const char *name;
+    int fd;             // this process's end of the FIFO, -1 when closed
+    shm_ring_t *ring;   // shared ring, inherited across fork
+    int writing;        // this process opened the ring for writing
+    char *pages;        // splice writer: pages handed to the pipe, reused once it has drained them
+    size_t pages_size;
+    size_t pages_next;
+} channel_t;
+
+int parse_transport(const char *text, transport_t *kind);
+const char *transport_name(transport_t kind);
+int channel_create(channel_t *ch, transport_t kind, const char *name);
+int channel_open(channel_t *ch, int flags);
+void *channel_buffer(channel_t *ch, size_t len);
+int channel_write(channel_t *ch, const void *data, size_t len);
+ssize_t channel_read(channel_t *ch, void *data, size_t len);
+ssize_t channel_read_full(channel_t *ch, void *data, size_t len);
+int channel_close(channel_t *ch);
+void channel_remove(channel_t *ch);
+
+#endif
@@ -0,0 +1,99 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "transport.h"
+
+#define BENCH_CHUNK (256 * 1024) // bytes per write() or ring write, as the ipc program streams them
+
+// Stream megabytes through a fresh channel of the given kind to a forked reader and
+// return the throughput in MB/s, counting until the reader has consumed the last byte
+static double run(transport_t kind, size_t megabytes)
+{
+    static char chunk[BENCH_CHUNK];
+    channel_t ch;
+    struct timespec start, end;
+    size_t total = megabytes << 20;
+
+    if (channel_create(&ch, kind, "bench_fifo") == -1)
+    {
+        perror("channel_create");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        size_t received = 0;
+        ssize_t got;
+        channel_open(&ch, O_RDONLY);
+        while ((got = channel_read(&ch, chunk, sizeof(chunk))) > 0)
+        {
+            received += (size_t)got;
+        }
+        channel_close(&ch);
+        _exit(received == total ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    memset(chunk, 'x', sizeof(chunk));
+    channel_open(&ch, O_WRONLY);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t sent = 0; sent < total; sent += BENCH_CHUNK)
+    {
+        size_t len = total - sent < BENCH_CHUNK ? total - sent : BENCH_CHUNK;
+        // A splice writer is given its own pages, as the ipc program fills them
+        char *data = channel_buffer(&ch, len);
+        if (channel_write(&ch, data != NULL ? data : chunk, len) == -1)
+        {
+            perror("channel_write");
+            exit(EXIT_FAILURE);
+        }
+    }
+    channel_close(&ch);
+
+    int status;
+    waitpid(pid, &status, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    channel_remove(&ch);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "%s reader lost data\n", transport_name(kind));
+        exit(EXIT_FAILURE);
+    }
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)megabytes / seconds;
+}
+
+// Compare the transports of the ipc program: transport_bench [MB...]
+int main(int argc, char *argv[])
+{
+    static const size_t default_sizes[] = { 1, 100, 1024 };
+    static const transport_t kinds[] = { TRANSPORT_FIFO, TRANSPORT_SHM, TRANSPORT_SPLICE };
+    size_t count = argc > 1 ? (size_t)(argc - 1) : sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+    printf("%10s %12s %12s %12s\n", "MB", "fifo MB/s", "shm MB/s", "splice MB/s");
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t megabytes = argc > 1 ? (size_t)atol(argv[i + 1]) : default_sizes[i];
+        if (megabytes == 0)
+        {
+            fprintf(stderr, "Usage: transport_bench [MB...]\n");
+            return EXIT_FAILURE;
+        }
+        printf("%10zu", megabytes);
+        for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+        {
+            printf(" %12.1f", run(kinds[k], megabytes));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return EXIT_SUCCESS;
+}